@@ -0,0 +1,137 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <lsp/json/json.h>
+
+/*
+ * Measures the conversion of text to and from json string literals with the contents of real files,
+ * e.g. the sources of this library or the generated types.h, which look like the documents sent in
+ * textDocument/didOpen or workspace/applyEdit.
+ *
+ *     $ LspEscapingBenchmark lsp/json/json.cpp build/generated/lsp/types.h
+ *
+ * Escaping is compared against a reference implementation that appends one character at a time.
+ */
+
+namespace{
+
+using Clock = std::chrono::steady_clock;
+
+constexpr int Repetitions = 200;
+
+std::string escapeReference(std::string_view str)
+{
+	std::string result;
+	result.reserve(str.size() + 2);
+	result.push_back('\"');
+
+	for(const char c : str)
+	{
+		switch(c)
+		{
+		case '\"':
+			result += "\\\"";
+			break;
+		case '\\':
+			result += "\\\\";
+			break;
+		case '\b':
+			result += "\\b";
+			break;
+		case '\f':
+			result += "\\f";
+			break;
+		case '\n':
+			result += "\\n";
+			break;
+		case '\r':
+			result += "\\r";
+			break;
+		case '\t':
+			result += "\\t";
+			break;
+		default:
+			if(static_cast<unsigned char>(c) < 0x20)
+			{
+				constexpr auto HexDigits = std::string_view("0123456789abcdef");
+				result += "\\u00";
+				result.push_back(HexDigits[static_cast<unsigned char>(c) >> 4]);
+				result.push_back(HexDigits[static_cast<unsigned char>(c) & 0xF]);
+			}
+			else
+			{
+				result.push_back(c);
+			}
+		}
+	}
+
+	result.push_back('\"');
+
+	return result;
+}
+
+// Returns the fastest time of a single call in milliseconds
+template<typename F>
+double measure(F&& func)
+{
+	auto best = std::chrono::duration<double, std::milli>::max();
+
+	for(int i = 0; i < Repetitions; ++i)
+	{
+		const auto start = Clock::now();
+		func();
+		best = std::min(best, std::chrono::duration<double, std::milli>(Clock::now() - start));
+	}
+
+	return best.count();
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+	if(argc < 2)
+	{
+		std::fprintf(stderr, "Usage: %s <file>...\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	std::printf("%-40s %10s %12s %12s %12s\n", "File", "Size", "Reference", "Escape", "Unescape");
+
+	for(int i = 1; i < argc; ++i)
+	{
+		auto file = std::ifstream(argv[i], std::ios::binary);
+
+		if(!file)
+		{
+			std::fprintf(stderr, "Failed to open '%s'\n", argv[i]);
+			return EXIT_FAILURE;
+		}
+
+		const auto text    = std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		const auto literal = lsp::json::toStringLiteral(text);
+
+		if(literal != escapeReference(text) || lsp::json::fromStringLiteral(literal) != text)
+		{
+			std::fprintf(stderr, "Escaping '%s' does not round trip\n", argv[i]);
+			return EXIT_FAILURE;
+		}
+
+		std::size_t sink = 0;
+		const auto reference = measure([&]{ sink += escapeReference(text).size(); });
+		const auto escape    = measure([&]{ sink += lsp::json::toStringLiteral(text).size(); });
+		const auto unescape  = measure([&]{ sink += lsp::json::fromStringLiteral(literal).size(); });
+
+		std::printf("%-40s %6zu KiB %9.3f ms %9.3f ms %9.3f ms\n", argv[i], text.size() / 1024, reference, escape, unescape);
+
+		if(sink == 0)
+			return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,191 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <lsp/connection.h>
+#include <lsp/io/sharedmemorystream.h>
+#include <lsp/io/socket.h>
+#include <lsp/io/standardio.h>
+#include <lsp/json/json.h>
+#include <lsp/process.h>
+
+/*
+ * Compares the transports a client and a server on the same machine can use:
+ * TCP loopback, Unix domain sockets, the standard I/O pipes of a child process and shared memory (Linux only).
+ *
+ * For each of them it measures the round trip of small messages, which is what most requests and notifications are,
+ * and the round trip of 1 MiB messages, like a large document that is opened or a long list of completion items.
+ *
+ *     $ LspTransportBenchmark
+ *
+ * The pipes and shared memory are measured against a child process that runs this executable with the argument 'echo'.
+ */
+
+namespace{
+
+using Clock = std::chrono::steady_clock;
+
+constexpr int         SmallRoundTrips  = 20000;
+constexpr int         LargeRoundTrips  = 200;
+constexpr std::size_t LargeMessageSize = 1024 * 1024;
+constexpr int         MessageCount     = SmallRoundTrips + LargeRoundTrips;
+constexpr auto        EchoArg          = std::string_view("echo");
+constexpr auto        LocalSocketName  =
+#ifdef __linux__
+	"@lsp-transport-benchmark";
+#else
+	"/tmp/lsp-transport-benchmark.sock";
+#endif
+constexpr unsigned short Port = 45950;
+
+// Sends every message that is received back to the sender
+void echo(lsp::io::Stream& stream)
+{
+	auto connection = lsp::Connection(stream);
+
+	for(int i = 0; i < MessageCount; ++i)
+		connection.writeMessageContent(connection.readMessageContent());
+}
+
+void run(std::string_view name, lsp::io::Stream& stream)
+{
+	auto connection = lsp::Connection(stream);
+
+	const auto small = lsp::Connection::MessageContent{
+		R"({"jsonrpc":"2.0","id":1,"method":"textDocument/hover","params":{"textDocument":{"uri":"file:///a.cpp"},"position":{"line":1,"character":2}}})",
+		lsp::json::Encoding::Json
+	};
+	auto start = Clock::now();
+
+	for(int i = 0; i < SmallRoundTrips; ++i)
+	{
+		connection.writeMessageContent(small);
+		(void)connection.readMessageContent();
+	}
+
+	const auto smallTime = std::chrono::duration<double, std::micro>(Clock::now() - start).count() / SmallRoundTrips;
+	const auto large     = lsp::Connection::MessageContent{
+		R"({"jsonrpc":"2.0","method":"textDocument/didOpen","params":{"text":")" + std::string(LargeMessageSize, 'x') + R"("}})",
+		lsp::json::Encoding::Json
+	};
+	start = Clock::now();
+
+	for(int i = 0; i < LargeRoundTrips; ++i)
+	{
+		connection.writeMessageContent(large);
+		(void)connection.readMessageContent();
+	}
+
+	const auto largeTime  = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / LargeRoundTrips;
+	const auto throughput = 2.0 * static_cast<double>(large.data.size()) / (1024.0 * 1024.0) / (largeTime / 1000.0);
+
+	std::printf("%-16.*s %8.1f us %10.2f ms %10.0f MiB/s\n", static_cast<int>(name.size()), name.data(), smallTime, largeTime, throughput);
+}
+
+// A listener only accepts connections once the server thread started to wait for one
+lsp::io::Socket connectWhenListening(lsp::io::Socket (*connect)())
+{
+	for(int attempt = 1;; ++attempt)
+	{
+		try
+		{
+			return connect();
+		}
+		catch(const lsp::io::Error&)
+		{
+			if(attempt == 100)
+				throw;
+
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+	}
+}
+
+void runSocket(std::string_view name, lsp::io::SocketListener& listener, lsp::io::Socket (*connect)())
+{
+	auto server = std::thread([&listener]{
+		try
+		{
+			auto socket = listener.listen();
+			echo(socket);
+		}
+		catch(const std::exception& e)
+		{
+			std::fprintf(stderr, "Server error: %s\n", e.what());
+		}
+	});
+
+	try
+	{
+		auto client = connectWhenListening(connect);
+		run(name, client);
+	}
+	catch(...)
+	{
+		// The server might still wait for a connection
+		server.detach();
+		throw;
+	}
+
+	server.join();
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+	try
+	{
+		if(argc > 1 && argv[1] == EchoArg)
+		{
+#ifndef LSP_SHARED_MEMORY_UNSUPPORTED
+			if(auto sharedMemory = lsp::io::SharedMemoryStream::fromEnvironment())
+			{
+				echo(*sharedMemory);
+				return EXIT_SUCCESS;
+			}
+#endif
+			echo(lsp::io::standardIO());
+			return EXIT_SUCCESS;
+		}
+
+		std::printf("%-16s %11s %13s %16s\n", "Transport", "Small", "1 MiB", "Throughput");
+
+		{
+			auto listener = lsp::io::SocketListener(Port);
+			runSocket("TCP loopback", listener, []{ return lsp::io::Socket::connect(lsp::io::Socket::Localhost, Port); });
+		}
+
+		{
+			auto listener = lsp::io::SocketListener::local(LocalSocketName);
+			runSocket("Unix socket", listener, []{ return lsp::io::Socket::connectLocal(LocalSocketName); });
+		}
+
+#ifndef LSP_PROCESS_UNSUPPORTED
+		{
+			auto process = lsp::Process(argv[0], {std::string(EchoArg)});
+			run("stdio pipes", process.stdIO());
+		}
+#endif
+
+#ifndef LSP_SHARED_MEMORY_UNSUPPORTED
+		{
+			auto sharedMemory = lsp::io::SharedMemoryStream::create();
+			auto process      = lsp::Process(argv[0], {std::string(EchoArg)}, sharedMemory);
+
+			if(sharedMemory.waitForPeer(std::chrono::seconds(1)))
+				run("shared memory", sharedMemory);
+		}
+#endif
+	}
+	catch(const std::exception& e)
+	{
+		std::fprintf(stderr, "Error: %s\n", e.what());
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -1,6 +1,8 @@
 #include <charconv>
+#include <chrono>
 #include <iostream>
 #include <lsp/connection.h>
+#include <lsp/io/sharedmemorystream.h>
 #include <lsp/io/socket.h>
 #include <lsp/io/standardio.h>
 #include <lsp/messagehandler.h>
@@ -13,8 +15,11 @@
  * It demonstrates how to create a client that communicates with a language server by either
  * 1. starting the server process and stdio
  *     $ LspClientExample --exe=LspServerExample
+ *   or via shared memory instead of stdio (Linux only)
+ *     $ LspClientExample --shared-memory --exe=LspServerExample
  * 2. connecting to an existing server instance via sockets
  *     $ LspClientExample --port=12345
+ *     $ LspClientExample --socket=/tmp/lsp-example.sock
  *
  * Once started, the client sends the following requests and notifications to the server:
  * 1. initialize          - Initializes the server
@@ -179,14 +184,18 @@ void runLanguageClient(lsp::io::Stream& io)
 
 struct Args{
 	std::optional<unsigned short> port;
+	std::string                   socketPath;
 	std::string                   executable;
 	std::vector<std::string>      executableArgs;
+	bool                          sharedMemory = false;
 };
 
 Args parseArgs(int argc, char** argv)
 {
-	constexpr auto PortArg = std::string_view("--port=");
-	constexpr auto ExeArg  = std::string_view("--exe=");
+	constexpr auto PortArg         = std::string_view("--port=");
+	constexpr auto SocketArg       = std::string_view("--socket=");
+	constexpr auto ExeArg          = std::string_view("--exe=");
+	constexpr auto SharedMemoryArg = std::string_view("--shared-memory");
 
 	auto args = Args();
 
@@ -211,6 +220,14 @@ Args parseArgs(int argc, char** argv)
 			else
 				std::cerr << "Invalid port: " << portStr << std::endl;
 		}
+		else if(arg.starts_with(SocketArg))
+		{
+			args.socketPath = arg.substr(SocketArg.size());
+		}
+		else if(arg == SharedMemoryArg)
+		{
+			args.sharedMemory = true;
+		}
 		else if(arg.starts_with(ExeArg))
 		{
 			const auto executable = arg.substr(ExeArg.size());
@@ -233,11 +250,13 @@ int main(int argc, char** argv)
 {
 	const auto args = parseArgs(argc, argv);
 
-	if(!args.port.has_value() && args.executable.empty())
+	if(!args.port.has_value() && args.socketPath.empty() && args.executable.empty())
 	{
 		std::cerr << R"(Available arguments:
     --port=<portnum>          Connect to a language server via socket on port <portnum>
-    --exe=<executable> <args> Launch language server <executable> and connect to it via stdio)" << std::endl;
+    --socket=<path>           Connect to a language server via Unix domain socket at <path> ('@name' for abstract)
+    --exe=<executable> <args> Launch language server <executable> and connect to it via stdio
+    --shared-memory           Use shared memory instead of stdio with --exe if the server supports it (Linux only))" << std::endl;
 		return 1;
 	}
 
@@ -249,9 +268,35 @@ int main(int argc, char** argv)
 			auto socket = lsp::io::Socket::connect(lsp::io::Socket::Localhost, *args.port);
 			runLanguageClient(socket);
 		}
+		else if(!args.socketPath.empty())
+		{
+			std::cerr << "Connecting to language server on '" << args.socketPath << '\'' << std::endl;
+			auto socket = lsp::io::Socket::connectLocal(args.socketPath);
+			runLanguageClient(socket);
+		}
 		else
 		{
 			std::cerr << "Launching language server executable '" << args.executable << '\'' << std::endl;
+#ifndef LSP_SHARED_MEMORY_UNSUPPORTED
+			if(args.sharedMemory)
+			{
+				auto sharedMemory = lsp::io::SharedMemoryStream::create();
+				auto proc         = lsp::Process(args.executable, args.executableArgs, sharedMemory);
+
+				// Servers that don't know about it or start too late to attach keep using stdio
+				if(sharedMemory.waitForPeer(std::chrono::seconds(1)))
+				{
+					std::cerr << "Connected via shared memory" << std::endl;
+					runLanguageClient(sharedMemory);
+				}
+				else
+				{
+					runLanguageClient(proc.stdIO());
+				}
+
+				return 0;
+			}
+#endif
 			auto proc = lsp::Process(args.executable, args.executableArgs);
 			runLanguageClient(proc.stdIO());
 		}
@@ -2,6 +2,7 @@
 #include <chrono>
 #include <iostream>
 #include <lsp/connection.h>
+#include <lsp/io/sharedmemorystream.h>
 #include <lsp/io/socket.h>
 #include <lsp/io/standardio.h>
 #include <lsp/messagehandler.h>
@@ -14,7 +15,9 @@
  * It demonstrates how to create a language server that is either
  * 1. listening for incoming client connections on a given port
  *     $ LspServerExample --port=12345
- * 2. started by a client and communicating via stdio
+ * 2. listening for incoming client connections on a Unix domain socket
+ *     $ LspServerExample --socket=/tmp/lsp-example.sock
+ * 3. started by a client and communicating via stdio or shared memory if the client passed it on (Linux only)
  *
  * Initialization, shutdown and the textDocument/hover request are handled by this example.
  * Incoming messages are written to stderr.
@@ -157,12 +160,10 @@ void runLanguageServer(lsp::io::Stream& io)
  * Socket server
  */
 
-void runSocketServer(unsigned short port)
+void runSocketServer(lsp::io::SocketListener&& socketListener)
 {
 	std::cerr << "Waiting for incoming connections..." << std::endl;
 
-	auto socketListener = lsp::io::SocketListener(port);
-
 	while(socketListener.isReady())
 	{
 		auto socket = socketListener.listen();
@@ -188,6 +189,14 @@ void runSocketServer(unsigned short port)
 
 void runStdioServer()
 {
+#ifndef LSP_SHARED_MEMORY_UNSUPPORTED
+	if(auto sharedMemory = lsp::io::SharedMemoryStream::fromEnvironment())
+	{
+		std::cerr << "Using shared memory passed on by the client" << std::endl;
+		runLanguageServer(*sharedMemory);
+		return;
+	}
+#endif
 	runLanguageServer(lsp::io::standardIO());
 }
 
@@ -195,9 +204,17 @@ void runStdioServer()
  * Argument parsing
  */
 
-std::optional<unsigned short> parsePortArg(int argc, char** argv)
+struct Args{
+	std::optional<unsigned short> port;
+	std::string                   socketPath;
+};
+
+Args parseArgs(int argc, char** argv)
 {
-	constexpr auto PortArg = std::string_view("--port=");
+	constexpr auto PortArg   = std::string_view("--port=");
+	constexpr auto SocketArg = std::string_view("--socket=");
+
+	auto args = Args();
 
 	for(int i = 1; i < argc; ++i)
 	{
@@ -211,7 +228,11 @@ std::optional<unsigned short> parsePortArg(int argc, char** argv)
 			(void)ptr;
 
 			if(ec == std::errc{})
-				return port;
+				args.port = port;
+		}
+		else if(arg.starts_with(SocketArg))
+		{
+			args.socketPath = arg.substr(SocketArg.size());
 		}
 		else
 		{
@@ -219,7 +240,7 @@ std::optional<unsigned short> parsePortArg(int argc, char** argv)
 		}
 	}
 
-	return std::nullopt;
+	return args;
 }
 
 } // namespace
@@ -228,17 +249,22 @@ int main(int argc, char** argv)
 {
 	try
 	{
-		const auto port = parsePortArg(argc, argv);
+		const auto args = parseArgs(argc, argv);
 
-		if(!port.has_value())
+		if(args.port.has_value())
 		{
-			std::cerr << "Starting stdio server - Launch with '--port=<portnum>' to run a socket server" << std::endl;
-			runStdioServer();
+			std::cerr << "Starting socket server on port " << *args.port << std::endl;
+			runSocketServer(lsp::io::SocketListener(*args.port));
+		}
+		else if(!args.socketPath.empty())
+		{
+			std::cerr << "Starting socket server on '" << args.socketPath << '\'' << std::endl;
+			runSocketServer(lsp::io::SocketListener::local(args.socketPath));
 		}
 		else
 		{
-			std::cerr << "Starting socket server on port " << *port << std::endl;
-			runSocketServer(*port);
+			std::cerr << "Starting stdio server - Launch with '--port=<portnum>' or '--socket=<path>' to run a socket server" << std::endl;
+			runStdioServer();
 		}
 
 		std::cerr << "Exiting" << std::endl;
@@ -1,7 +1,13 @@
+#include <array>
 #include <cctype>
 #include <cstring>
 #include <charconv>
-#include <optional>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <thread>
+#include <vector>
 #include <algorithm>
 #include <string_view>
 #include <system_error>
@@ -33,6 +39,12 @@ namespace{
  * Message logging
  */
 
+constexpr std::string_view JsonContentType{"application/vscode-jsonrpc"};
+constexpr std::string_view CborContentType{"application/cbor"};
+
+// Larger headers are rejected so garbage input can't make the input buffer grow forever
+constexpr std::size_t MaxHeaderSize = 64 * 1024;
+
 #if LSP_MESSAGE_DEBUG_LOG
 void debugLogMessageJson([[maybe_unused]] const std::string& messageType, [[maybe_unused]] const lsp::json::Any& json)
 {
@@ -42,6 +54,14 @@ void debugLogMessageJson([[maybe_unused]] const std::string& messageType, [[mayb
 	OutputDebugStringA((messageType + ": " + lsp::json::stringify(json, true) + '\n').c_str());
 #endif
 }
+
+// Encoded content is only decoded on platforms that actually log it
+void debugLogMessageContent([[maybe_unused]] const std::string& messageType, [[maybe_unused]] std::string_view data, [[maybe_unused]] lsp::json::Encoding encoding)
+{
+#if defined(__APPLE__) || defined(_WIN32)
+	debugLogMessageJson(messageType, encoding == lsp::json::Encoding::Cbor ? lsp::json::parseCbor(data) : lsp::json::parse(data));
+#endif
+}
 #endif
 
 std::string_view trimWhitespace(std::string_view str)
@@ -64,9 +84,18 @@ bool equalCaseInsensitive(std::string_view lhs, std::string_view rhs)
 		});
 }
 
-void verifyContentType(std::string_view contentType)
+// The media type without parameters like the charset
+std::string_view mediaType(std::string_view contentType)
 {
-	if(!contentType.starts_with("application/vscode-jsonrpc"))
+	return trimWhitespace(contentType.substr(0, contentType.find(';')));
+}
+
+void verifyContentType(std::string_view contentType, bool allowCbor)
+{
+	if(allowCbor && equalCaseInsensitive(mediaType(contentType), CborContentType))
+		return;
+
+	if(!contentType.starts_with(JsonContentType))
 		throw ConnectionError{"Protocol: Unsupported or invalid content type: " + std::string(contentType)};
 
 	constexpr std::string_view charsetKey{"charset="};
@@ -80,61 +109,520 @@ void verifyContentType(std::string_view contentType)
 	}
 }
 
+/*
+ * Message header
+ */
+
+// Large enough for the longest header this library writes
+using MessageHeaderBuffer = std::array<char, 256>;
+
+std::string_view formatMessageHeader(MessageHeaderBuffer& buffer, std::size_t contentLength, json::Encoding encoding, bool acceptsCbor)
+{
+	char* end = buffer.data();
+	const auto append = [&end](std::string_view str)
+	{
+		std::memcpy(end, str.data(), str.size());
+		end += str.size();
+	};
+
+	append("Content-Length: ");
+	end = std::to_chars(end, buffer.data() + buffer.size(), contentLength).ptr;
+	append("\r\nContent-Type: ");
+
+	if(encoding == json::Encoding::Cbor)
+	{
+		append(CborContentType);
+	}
+	else
+	{
+		append(JsonContentType);
+		append("; charset=utf-8");
+	}
+
+	append("\r\n");
+
+	if(acceptsCbor)
+	{
+		append("Accept: ");
+		append(JsonContentType);
+		append(", ");
+		append(CborContentType);
+		append("\r\n");
+	}
+
+	append("\r\n");
+
+	return {buffer.data(), static_cast<std::size_t>(end - buffer.data())};
+}
+
 } // namespace
 
 /*
  * Connection::InputReader
- * Wrapper around io::Stream that allows for peeking and reading single chars
+ * Buffered wrapper around io::Stream that reads data in large chunks instead of single bytes.
+ * The buffer persists between messages so data belonging to the next message isn't lost.
  */
 
 class Connection::InputReader{
 public:
+	static constexpr std::size_t BufferSize = 16 * 1024;
+
 	InputReader(io::Stream& stream)
 		: m_stream{stream}
+		, m_buffer(BufferSize)
 	{
 	}
 
 	char peek()
 	{
-		if(!m_peek.has_value())
-			m_peek = get();
+		if(m_pos == m_end)
+			fill();
 
-		return m_peek.value();
+		return m_buffer[m_pos];
 	}
 
-	char get()
+	// Returns the next line without the terminating '\r\n'.
+	// Throws if the line including the terminator is longer than maxSize.
+	// The returned view is only valid until the next call to any of the read functions.
+	std::string_view readLine(std::size_t maxSize)
 	{
-		if(m_peek.has_value())
+		std::size_t searchPos = m_pos;
+
+		while(true)
 		{
-			const char c = m_peek.value();
-			m_peek.reset();
-			return c;
-		}
+			const auto* data = m_buffer.data();
+
+			if(const auto* newLine = static_cast<const char*>(std::memchr(data + searchPos, '\n', m_end - searchPos)); newLine)
+			{
+				const auto lineEnd = static_cast<std::size_t>(newLine - data);
+
+				if(lineEnd + 1 - m_pos > maxSize)
+					throw ConnectionError{"Protocol: Message header is too large"};
+
+				if(lineEnd == m_pos || data[lineEnd - 1] != '\r')
+					throw ConnectionError("Protocol: Unexpected '\\n' in header field, expected '\\r\\n'");
 
-		char c = io::Stream::Eof;
-		read(&c, 1);
-		return c;
+				const auto line = std::string_view{data + m_pos, lineEnd - 1 - m_pos};
+				m_pos = lineEnd + 1;
+				return line;
+			}
+
+			if(m_end - m_pos >= maxSize)
+				throw ConnectionError{"Protocol: Message header is too large"};
+
+			searchPos = m_end - m_pos;
+			compact();
+
+			if(m_end == m_buffer.size())
+				m_buffer.resize(m_buffer.size() * 2);
+
+			fill();
+		}
 	}
 
 	void read(char* buffer, std::size_t size)
 	{
-		if(size > 0)
+		const auto buffered = std::min(size, m_end - m_pos);
+		std::memcpy(buffer, m_buffer.data() + m_pos, buffered);
+		m_pos += buffered;
+		buffer += buffered;
+		size -= buffered;
+
+		// Large payloads are read directly into the destination to avoid copying them twice
+		if(size >= m_buffer.size())
 		{
-			if(m_peek.has_value())
+			m_stream.read(buffer, size);
+			return;
+		}
+
+		while(size > 0)
+		{
+			fill();
+
+			const auto count = std::min(size, m_end - m_pos);
+			std::memcpy(buffer, m_buffer.data() + m_pos, count);
+			m_pos += count;
+			buffer += count;
+			size -= count;
+		}
+	}
+
+	// The data that was received but not read yet
+	std::string_view buffered() const
+	{
+		return {m_buffer.data() + m_pos, m_end - m_pos};
+	}
+
+	// Appends the data that is available without waiting and makes room for at least minSize bytes of unread data first.
+	// Returns false if no data was available.
+	bool receive(std::size_t minSize)
+	{
+		compact();
+
+		// The buffer grows for large messages since they have to be received completely before they are read
+		if(m_end == 0 && minSize <= BufferSize && m_buffer.size() > BufferSize)
+		{
+			m_buffer.resize(BufferSize);
+			m_buffer.shrink_to_fit();
+		}
+		else if(m_buffer.size() < minSize)
+		{
+			m_buffer.resize(minSize);
+		}
+		else if(m_end == m_buffer.size())
+		{
+			m_buffer.resize(m_buffer.size() * 2);
+		}
+
+		const auto bytesRead = m_stream.tryReadSome(m_buffer.data() + m_end, m_buffer.size() - m_end);
+
+		if(!bytesRead.has_value())
+			return false;
+
+		if(*bytesRead == 0)
+			throw ConnectionError{"Connection lost"};
+
+		m_end += *bytesRead;
+		return true;
+	}
+
+private:
+	io::Stream&       m_stream;
+	std::vector<char> m_buffer;
+	std::size_t       m_pos = 0;
+	std::size_t       m_end = 0;
+
+	// Moves unread data to the front of the buffer
+	void compact()
+	{
+		if(m_pos > 0)
+		{
+			std::memmove(m_buffer.data(), m_buffer.data() + m_pos, m_end - m_pos);
+			m_end -= m_pos;
+			m_pos = 0;
+		}
+	}
+
+	// Appends as much data as is currently available from the stream (at least one byte)
+	void fill()
+	{
+		if(m_pos == m_end)
+			m_pos = m_end = 0;
+
+		const auto bytesRead = m_stream.readSome(m_buffer.data() + m_end, m_buffer.size() - m_end);
+
+		if(bytesRead == 0)
+			throw ConnectionError{"Connection lost"};
+
+		m_end += bytesRead;
+	}
+};
+
+/*
+ * OutputQueue
+ */
+
+class Connection::OutputQueue{
+public:
+	explicit OutputQueue(Connection& connection)
+		: m_connection{connection}
+	{
+	}
+
+	~OutputQueue()
+	{
+		std::unique_lock lock{m_mutex};
+		m_stop = true;
+
+		// The remaining messages are written before the connection is destroyed
+		if(m_thread.joinable())
+		{
+			lock.unlock();
+			m_messageQueued.notify_one();
+			m_thread.join();
+		}
+		else if(!m_error)
+		{
+			try
 			{
-				*buffer = m_peek.value();
-				m_peek.reset();
-				++buffer;
-				--size;
+				while(m_status.queuedMessages != 0)
+					writeBatch(lock, true);
 			}
+			catch(...)
+			{
+			}
+		}
+	}
 
-			m_stream.read(buffer, size);
+	void push(MessageContent&& content, MessagePriority priority)
+	{
+		std::unique_lock lock{m_mutex};
+		const auto size = content.data.size();
+
+		// A message that is larger than the limit by itself is queued once the queue is empty.
+		// Event loops stop reading input while the queue is full instead since waiting here would block the loop itself.
+		if(!m_onMessageQueued && !m_error && m_status.queuedMessages != 0 && m_status.queuedBytes + size > m_limit)
+		{
+			++m_status.blockedWrites;
+			m_messagesWritten.wait(lock, [this, size]
+			{
+				return m_error || m_status.queuedMessages == 0 || m_status.queuedBytes + size <= m_limit;
+			});
+		}
+
+		if(m_error)
+			std::rethrow_exception(m_error);
+
+		m_lanes[static_cast<std::size_t>(priority)].push_back(std::move(content));
+		++m_status.queuedMessages;
+		m_status.queuedBytes += size;
+
+		if(m_onMessageQueued)
+		{
+			const auto onMessageQueued = m_onMessageQueued;
+			lock.unlock();
+			onMessageQueued();
+			return;
+		}
+
+		if(!m_thread.joinable())
+			m_thread = std::thread{[this](){ run(); }};
+
+		lock.unlock();
+		m_messageQueued.notify_one();
+	}
+
+	void flush()
+	{
+		std::unique_lock lock{m_mutex};
+		m_messagesWritten.wait(lock, [this](){ return m_error || m_status.queuedMessages == 0; });
+
+		if(m_error)
+			std::rethrow_exception(m_error);
+	}
+
+	void setLimit(std::size_t bytes)
+	{
+		{
+			std::lock_guard lock{m_mutex};
+			m_limit = bytes;
+		}
+
+		m_messagesWritten.notify_all();
+	}
+
+	OutputQueueStatus status() const
+	{
+		std::lock_guard lock{m_mutex};
+		return m_status;
+	}
+
+	bool isFull() const
+	{
+		std::lock_guard lock{m_mutex};
+		return m_status.queuedMessages != 0 && m_status.queuedBytes >= m_limit;
+	}
+
+	void setMessageQueuedCallback(std::function<void()>&& callback)
+	{
+		std::unique_lock lock{m_mutex};
+
+		// The writer thread exits once it wrote everything that is queued
+		if(callback && m_thread.joinable())
+		{
+			m_stop = true;
+			lock.unlock();
+			m_messageQueued.notify_one();
+			m_thread.join();
+			lock.lock();
+			m_stop = false;
+		}
+
+		m_onMessageQueued = std::move(callback);
+
+		if(m_status.queuedMessages == 0)
+			return;
+
+		if(m_onMessageQueued)
+		{
+			const auto onMessageQueued = m_onMessageQueued;
+			lock.unlock();
+			onMessageQueued();
+		}
+		else if(!m_thread.joinable())
+		{
+			m_thread = std::thread{[this](){ run(); }};
+		}
+	}
+
+	bool writeAvailable()
+	{
+		std::unique_lock lock{m_mutex};
+
+		if(m_error)
+			std::rethrow_exception(m_error);
+
+		while(m_status.queuedMessages != 0)
+		{
+			if(!writeBatch(lock, false))
+				return false;
 		}
+
+		return true;
 	}
 
 private:
-	io::Stream&         m_stream;
-	std::optional<char> m_peek;
+	// Limits of how many messages are passed to the stream at once
+	static constexpr std::size_t MaxBatchMessages = 32;
+	static constexpr std::size_t MaxBatchBytes    = 64 * 1024;
+	static constexpr std::size_t PriorityCount    = 3;
+
+	Connection&                      m_connection;
+	std::thread                      m_thread;
+	std::function<void()>            m_onMessageQueued;
+	mutable std::mutex               m_mutex;
+	std::condition_variable          m_messageQueued;
+	std::condition_variable          m_messagesWritten;
+	std::deque<MessageContent>       m_lanes[PriorityCount];
+	OutputQueueStatus                m_status;
+	std::size_t                      m_limit = DefaultOutputQueueLimit;
+	std::exception_ptr               m_error;
+	bool                             m_stop  = false;
+	// The batch that is being written. Only accessed by whoever is writing.
+	std::vector<MessageContent>      m_batch;
+	std::vector<MessageHeaderBuffer> m_headers;
+	std::vector<std::string_view>    m_unwritten;
+	std::size_t                      m_batchBytes = 0;
+
+	void run()
+	{
+		std::unique_lock lock{m_mutex};
+
+		while(true)
+		{
+			m_messageQueued.wait(lock, [this](){ return m_stop || m_status.queuedMessages != 0; });
+
+			if(m_status.queuedMessages == 0)
+				return;
+
+			try
+			{
+				writeBatch(lock, true);
+			}
+			catch(...)
+			{
+				return;
+			}
+		}
+	}
+
+	// Called with the mutex locked. Returns false if the batch could not be written completely without waiting.
+	bool writeBatch(std::unique_lock<std::mutex>& lock, bool wait)
+	{
+		if(m_unwritten.empty())
+			takeBatch();
+
+		lock.unlock();
+
+		try
+		{
+			std::lock_guard writeLock{m_connection.m_writeMutex};
+
+			if(wait)
+				m_connection.m_stream.writeBuffers(m_unwritten);
+			else
+				skipWritten(m_connection.m_stream.tryWriteBuffers(m_unwritten));
+		}
+		catch(...)
+		{
+			lock.lock();
+			setError(std::current_exception());
+			std::rethrow_exception(m_error);
+		}
+
+		lock.lock();
+
+		if(!wait && !m_unwritten.empty())
+			return false;
+
+		m_unwritten.clear();
+		m_batch.clear();
+		m_status.queuedMessages -= m_headers.size();
+		m_status.queuedBytes -= m_batchBytes;
+		m_messagesWritten.notify_all();
+
+		return true;
+	}
+
+	// Small messages are collected from all lanes starting with the highest priority
+	void takeBatch()
+	{
+		m_batchBytes = 0;
+
+		for(auto& lane : m_lanes)
+		{
+			while(!lane.empty() && m_batch.size() < MaxBatchMessages && m_batchBytes < MaxBatchBytes)
+			{
+				m_batchBytes += lane.front().data.size();
+				m_batch.push_back(std::move(lane.front()));
+				lane.pop_front();
+			}
+		}
+
+		m_headers.resize(m_batch.size());
+
+		for(std::size_t i = 0; i < m_batch.size(); ++i)
+		{
+			const auto& content     = m_batch[i];
+			const auto  acceptsCbor = content.encoding == json::Encoding::Json && m_connection.m_allowCbor;
+
+			m_unwritten.push_back(formatMessageHeader(m_headers[i], content.data.size(), content.encoding, acceptsCbor));
+			m_unwritten.push_back(content.data);
+		}
+	}
+
+	void skipWritten(std::size_t size)
+	{
+		auto it = m_unwritten.begin();
+
+		for(; it != m_unwritten.end() && size >= it->size(); ++it)
+			size -= it->size();
+
+		m_unwritten.erase(m_unwritten.begin(), it);
+
+		if(!m_unwritten.empty())
+			m_unwritten.front().remove_prefix(size);
+	}
+
+	// Called with the mutex locked. Remaining messages are discarded since the stream can't be written to anymore.
+	void setError(std::exception_ptr exception)
+	{
+		try
+		{
+			std::rethrow_exception(exception);
+		}
+		catch(const ConnectionError&)
+		{
+			m_error = std::current_exception();
+		}
+		catch(const std::exception& e)
+		{
+			m_error = std::make_exception_ptr(ConnectionError{e.what()});
+		}
+		catch(...)
+		{
+			m_error = std::make_exception_ptr(ConnectionError{"Unknown error"});
+		}
+
+		for(auto& lane : m_lanes)
+			lane.clear();
+
+		m_batch.clear();
+		m_unwritten.clear();
+		m_status.queuedMessages = 0;
+		m_status.queuedBytes = 0;
+		m_messagesWritten.notify_all();
+	}
 };
 
 /*
@@ -144,44 +632,144 @@ private:
 struct Connection::MessageHeader{
 	std::size_t contentLength = 0;
 	std::string contentType   = "application/vscode-jsonrpc; charset=utf-8";
+	bool        acceptsCbor   = false;
 };
 
-Connection::Connection(io::Stream& stream)
+Connection::Connection(io::Stream& stream, bool allowCbor)
 	: m_stream{stream}
+	, m_inputReader{std::make_unique<InputReader>(stream)}
+	, m_allowCbor{allowCbor}
+	, m_outputQueue{std::make_unique<OutputQueue>(*this)}
 {
 }
 
+Connection::~Connection() = default;
+
+json::Encoding Connection::outputEncoding() const
+{
+	return m_peerAcceptsCbor.load(std::memory_order_relaxed) ? json::Encoding::Cbor : json::Encoding::Json;
+}
+
 json::Any Connection::readMessage()
 {
-	try
-	{
-		std::lock_guard lock{m_readMutex};
-		InputReader reader{m_stream};
+	std::unique_lock lock{m_readMutex};
+	const auto header = readMessageHeaderChecked();
+	const auto data   = readMessageData(header);
+	lock.unlock();
 
-		if(reader.peek() == io::Stream::Eof)
-			throw ConnectionError{"Connection lost"};
+	auto json = isCborContent(header) ? json::parseCbor(data) : json::parse(data);
+#if LSP_MESSAGE_DEBUG_LOG
+	debugLogMessageJson("incoming", json);
+#endif
 
-		const auto header = readMessageHeader(reader);
+	return json;
+}
+
+json::Document Connection::readMessageDocument()
+{
+	std::unique_lock lock{m_readMutex};
+	const auto header = readMessageHeaderChecked();
+	const auto data   = readMessageData(header);
+	lock.unlock();
 
+	auto document = isCborContent(header) ? json::parseCborDocument(data) : json::parseDocument(data);
+#if LSP_MESSAGE_DEBUG_LOG
+	debugLogMessageJson("incoming", document.root());
+#endif
+
+	return document;
+}
+
+std::string Connection::readMessageText()
+{
+	auto content = readMessageContent();
+
+	if(content.encoding == json::Encoding::Cbor)
+		return json::stringify(json::parseCbor(content.data));
+
+	return std::move(content.data);
+}
+
+Connection::MessageContent Connection::readMessageContent()
+{
+	std::lock_guard lock{m_readMutex};
+	const auto header = readMessageHeaderChecked();
+	const auto isCbor = isCborContent(header);
+
+	MessageContent content{readMessageData(header), isCbor ? json::Encoding::Cbor : json::Encoding::Json};
+#if LSP_MESSAGE_DEBUG_LOG
+	debugLogMessageContent("incoming", content.data, content.encoding);
+#endif
+
+	return content;
+}
+
+bool Connection::isCborContent(const MessageHeader& header) const
+{
+	return m_allowCbor && equalCaseInsensitive(mediaType(header.contentType), CborContentType);
+}
+
+std::string Connection::readMessageData(const MessageHeader& header)
+{
+	try
+	{
 		std::string content;
 		content.resize(header.contentLength);
-		reader.read(&content[0], header.contentLength);
+		m_inputReader->read(content.data(), header.contentLength);
 
 		// Verify only after reading the entire message so no partially unread message is left in the stream
-		verifyContentType(header.contentType);
+		verifyContentType(header.contentType, m_allowCbor);
 
-		auto json = json::parse(content);
+		return content;
+	}
+	catch(const ConnectionError&)
+	{
+		throw;
+	}
+	catch(const std::exception& e)
+	{
+		throw ConnectionError{e.what()};
+	}
+	catch(...)
+	{
+		throw ConnectionError{"Unknown error"};
+	}
+}
+
+void Connection::writeMessage(const json::Any& content)
+{
+	try
+	{
 #if LSP_MESSAGE_DEBUG_LOG
-		debugLogMessageJson("incoming", json);
+		debugLogMessageJson("outgoing", content);
 #endif
-
-		return json;
+		const auto encoding = outputEncoding();
+		writeMessageData(encoding == json::Encoding::Cbor ? json::toCbor(content) : json::stringify(content), encoding);
 	}
 	catch(const ConnectionError&)
 	{
 		throw;
 	}
-	catch(const json::ParseError&)
+	catch(const std::exception& e)
+	{
+		throw ConnectionError{e.what()};
+	}
+	catch(...)
+	{
+		throw ConnectionError{"Unknown error"};
+	}
+}
+
+void Connection::writeMessageText(const std::string& content)
+{
+	try
+	{
+#if LSP_MESSAGE_DEBUG_LOG
+		debugLogMessageContent("outgoing", content, json::Encoding::Json);
+#endif
+		writeMessageData(content, json::Encoding::Json);
+	}
+	catch(const ConnectionError&)
 	{
 		throw;
 	}
@@ -195,14 +783,14 @@ json::Any Connection::readMessage()
 	}
 }
 
-void Connection::writeMessage(const json::Any& content)
+void Connection::writeMessageContent(const MessageContent& content)
 {
 	try
 	{
 #if LSP_MESSAGE_DEBUG_LOG
-		debugLogMessageJson("outgoing", content);
+		debugLogMessageContent("outgoing", content.data, content.encoding);
 #endif
-		writeMessageData(json::stringify(content));
+		writeMessageData(content.data, content.encoding);
 	}
 	catch(const ConnectionError&)
 	{
@@ -218,15 +806,148 @@ void Connection::writeMessage(const json::Any& content)
 	}
 }
 
-Connection::MessageHeader Connection::readMessageHeader(InputReader& reader)
+void Connection::queueMessage(const json::Any& content, MessagePriority priority)
+{
+#if LSP_MESSAGE_DEBUG_LOG
+	debugLogMessageJson("outgoing", content);
+#endif
+	const auto encoding = outputEncoding();
+	m_outputQueue->push({encoding == json::Encoding::Cbor ? json::toCbor(content) : json::stringify(content), encoding}, priority);
+}
+
+void Connection::queueMessageContent(MessageContent&& content, MessagePriority priority)
+{
+#if LSP_MESSAGE_DEBUG_LOG
+	debugLogMessageContent("outgoing", content.data, content.encoding);
+#endif
+	m_outputQueue->push(std::move(content), priority);
+}
+
+bool Connection::receiveAvailable()
+{
+	std::lock_guard lock{m_readMutex};
+
+	try
+	{
+		return m_inputReader->receive(bufferedMessageSize());
+	}
+	catch(const ConnectionError&)
+	{
+		throw;
+	}
+	catch(const std::exception& e)
+	{
+		throw ConnectionError{e.what()};
+	}
+	catch(...)
+	{
+		throw ConnectionError{"Unknown error"};
+	}
+}
+
+bool Connection::hasBufferedMessage()
+{
+	std::lock_guard lock{m_readMutex};
+	const auto size = bufferedMessageSize();
+
+	return size != 0 && m_inputReader->buffered().size() >= size;
+}
+
+void Connection::setMessageQueuedCallback(std::function<void()> callback)
+{
+	m_outputQueue->setMessageQueuedCallback(std::move(callback));
+}
+
+bool Connection::writeQueuedMessages()
+{
+	return m_outputQueue->writeAvailable();
+}
+
+bool Connection::isOutputQueueFull() const
+{
+	return m_outputQueue->isFull();
+}
+
+void Connection::flushOutputQueue()
+{
+	m_outputQueue->flush();
+}
+
+void Connection::setOutputQueueLimit(std::size_t bytes)
+{
+	m_outputQueue->setLimit(bytes);
+}
+
+Connection::OutputQueueStatus Connection::outputQueueStatus() const
+{
+	return m_outputQueue->status();
+}
+
+Connection::MessageHeader Connection::readMessageHeaderChecked()
+{
+	try
+	{
+		if(m_inputReader->peek() == io::Stream::Eof)
+			throw ConnectionError{"Connection lost"};
+
+		auto header = readMessageHeader();
+
+		if(m_allowCbor && (header.acceptsCbor || isCborContent(header)))
+			m_peerAcceptsCbor.store(true, std::memory_order_relaxed);
+
+		return header;
+	}
+	catch(const ConnectionError&)
+	{
+		throw;
+	}
+	catch(const std::exception& e)
+	{
+		throw ConnectionError{e.what()};
+	}
+	catch(...)
+	{
+		throw ConnectionError{"Unknown error"};
+	}
+}
+
+std::size_t Connection::bufferedMessageSize() const
+{
+	const auto data      = m_inputReader->buffered();
+	const auto headerEnd = data.find("\r\n\r\n");
+
+	if(headerEnd == std::string_view::npos)
+	{
+		if(data.size() > MaxHeaderSize)
+			throw ConnectionError{"Protocol: Message header is too large"};
+
+		return 0;
+	}
+
+	MessageHeader header;
+
+	for(auto lines = data.substr(0, headerEnd + 2); !lines.empty();)
+	{
+		const auto lineEnd = lines.find("\r\n");
+		parseHeaderValue(header, lines.substr(0, lineEnd));
+		lines.remove_prefix(lineEnd + 2);
+	}
+
+	return headerEnd + 4 + header.contentLength;
+}
+
+Connection::MessageHeader Connection::readMessageHeader()
 {
 	MessageHeader header;
 
-	while(reader.peek() != '\r')
-		readNextMessageHeaderField(header, reader);
+	auto remainingSize = MaxHeaderSize;
 
-	if(reader.get() != '\r' || reader.get() != '\n')
-		throw ConnectionError("Protocol: Expected header to be terminated by '\\r\\n'");
+	// The header is terminated by an empty line
+	for(auto line = m_inputReader->readLine(remainingSize); !line.empty(); line = m_inputReader->readLine(remainingSize))
+	{
+		remainingSize -= line.size() + 2;
+		parseHeaderValue(header, line);
+	}
 
 	return header;
 }
@@ -253,44 +974,31 @@ void Connection::parseHeaderValue(MessageHeader& header, std::string_view line)
 		{
 			header.contentType = std::string{value.data(), value.size()};
 		}
-	}
-}
-
-void Connection::readNextMessageHeaderField(MessageHeader& header, InputReader& reader)
-{
-	if(reader.peek() == std::char_traits<char>::eof())
-		throw ConnectionError{"Connection lost"};
-
-	std::string lineData;
-
-	while(reader.peek() != '\r')
-	{
-		const auto c = reader.get();
+		else if(equalCaseInsensitive(key, "Accept"))
+		{
+			for(auto types = value; !types.empty();)
+			{
+				const auto separatorIdx = types.find(',');
 
-		if(c == '\n')
-			throw ConnectionError("Protocol: Unexpected '\\n' in header field, expected '\\r\\n'");
+				if(equalCaseInsensitive(mediaType(types.substr(0, separatorIdx)), CborContentType))
+					header.acceptsCbor = true;
 
-		lineData.push_back(c);
+				types.remove_prefix(separatorIdx == std::string_view::npos ? types.size() : separatorIdx + 1);
+			}
+		}
 	}
-
-	parseHeaderValue(header, lineData);
-
-	if(reader.get() != '\r' || reader.get() != '\n')
-		throw ConnectionError("Protocol: Expected header field to be terminated by '\\r\\n'");
 }
 
-void Connection::writeMessageData(const std::string& content)
+void Connection::writeMessageData(const std::string& content, json::Encoding encoding)
 {
-	std::lock_guard lock{m_writeMutex};
-	MessageHeader header{content.size()};
-	const auto messageStr = messageHeaderString(header) + content;
-	m_stream.write(messageStr.data(), messageStr.size());
-}
+	MessageHeaderBuffer    headerBuffer;
+	const std::string_view buffers[] = {
+		formatMessageHeader(headerBuffer, content.size(), encoding, encoding == json::Encoding::Json && m_allowCbor),
+		content
+	};
 
-std::string Connection::messageHeaderString(const MessageHeader& header)
-{
-	return "Content-Length: " + std::to_string(header.contentLength) + "\r\n" +
-	       "Content-Type: " + header.contentType + "\r\n\r\n";
+	std::lock_guard lock{m_writeMutex};
+	m_stream.writeBuffers(buffers);
 }
 
 } // namespace lsp
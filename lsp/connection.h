@@ -1,5 +1,10 @@
 #pragma once
 
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <lsp/exception.h>
@@ -7,6 +12,8 @@
 namespace lsp{
 namespace json{
 class Any;
+class Document;
+enum class Encoding : std::uint8_t;
 } // namespace json
 
 namespace io{
@@ -16,27 +23,121 @@ class Stream;
 /*
  * Connection between the server and a client.
  * I/O happens via lsp::io::Stream so the underlying implementation can be anything from stdio to sockets
+ *
+ * Messages are json text unless the connection allows CBOR and the peer supports it as well.
+ * A connection that allows it announces this with an Accept header in its json messages which
+ * editors ignore. Once the peer did the same or sent CBOR content all messages written with
+ * writeMessage and all responses of a MessageHandler are CBOR.
+ *
+ * Messages can also be queued instead of being written directly. The queue is drained by a writer thread
+ * that is started on first use, so the caller never waits for the stream unless the queue is full.
  */
 class Connection{
 public:
-	Connection(io::Stream& stream);
+	struct MessageContent{
+		std::string    data;
+		json::Encoding encoding;
+	};
+
+	/*
+	 * Queued messages are written in order of priority and in the order they were queued within the same priority
+	 */
+	enum class MessagePriority : std::uint8_t{
+		High,   // Responses and messages that must not be overtaken by them like progress or the messages sent by a request handler
+		Normal, // Requests and notifications
+		Low     // Bulk notifications like diagnostics or telemetry
+	};
+
+	struct OutputQueueStatus{
+		std::size_t   queuedMessages = 0; // Messages that were not written yet
+		std::size_t   queuedBytes    = 0;
+		std::uint64_t blockedWrites  = 0; // How often queueing a message had to wait because the queue was full
+	};
+
+	static constexpr std::size_t DefaultOutputQueueLimit = 32 * 1024 * 1024;
+
+	Connection(io::Stream& stream, bool allowCbor = false);
+	~Connection();
+
+	// The encoding that is used for writing messages
+	json::Encoding outputEncoding() const;
 
 	json::Any readMessage();
 	void writeMessage(const json::Any& content);
+	// Writes an already serialized message
+	void writeMessageText(const std::string& content);
 
-private:
-	io::Stream& m_stream;
-	std::mutex  m_readMutex;
-	std::mutex  m_writeMutex;
+	/*
+	 * Like readMessage but the message is allocated from an arena owned by the returned document
+	 * which is freed all at once when the document is destroyed.
+	 */
+	json::Document readMessageDocument();
 
+	/*
+	 * Returns the unparsed content of the next message. CBOR content is converted to json text.
+	 */
+	std::string readMessageText();
+
+	/*
+	 * Returns the unparsed content of the next message in the encoding it was received in
+	 */
+	MessageContent readMessageContent();
+	void writeMessageContent(const MessageContent& content);
+
+	/*
+	 * Output queue
+	 *
+	 * Several small messages are written with a single call to the stream.
+	 * Queueing blocks while the size of the queue exceeds its limit.
+	 * Errors of the writer thread are rethrown by the next call to queueMessage or flushOutputQueue.
+	 * Queued messages are not ordered relative to messages that are written directly.
+	 */
+	void queueMessage(const json::Any& content, MessagePriority priority = MessagePriority::Normal);
+	void queueMessageContent(MessageContent&& content, MessagePriority priority = MessagePriority::Normal);
+	// Blocks until all queued messages are written
+	void flushOutputQueue();
+	void setOutputQueueLimit(std::size_t bytes);
+	OutputQueueStatus outputQueueStatus() const;
+
+	/*
+	 * Event driven I/O
+	 *
+	 * Used by lsp::Reactor to serve many connections from a single thread. The stream has to support non-blocking I/O.
+	 * receiveAvailable reads the data that is available without waiting for more and returns false if there was none.
+	 * hasBufferedMessage returns whether a complete message was received which can then be read without blocking.
+	 *
+	 * A message queued callback replaces the writer thread of the output queue. It is invoked by the thread that queued
+	 * a message and writeQueuedMessages has to be called afterwards. It writes as much as possible without waiting and
+	 * returns whether all queued messages were written. Queueing never blocks in this mode so the event loop should stop
+	 * reading input while isOutputQueueFull returns true.
+	 */
+	bool receiveAvailable();
+	bool hasBufferedMessage();
+	void setMessageQueuedCallback(std::function<void()> callback);
+	bool writeQueuedMessages();
+	bool isOutputQueueFull() const;
+
+private:
+	friend class Reactor;
 	struct MessageHeader;
 	class InputReader;
+	class OutputQueue;
+
+	io::Stream&                  m_stream;
+	std::unique_ptr<InputReader> m_inputReader;
+	std::mutex                   m_readMutex;
+	std::mutex                   m_writeMutex;
+	const bool                   m_allowCbor;
+	std::atomic<bool>            m_peerAcceptsCbor = false;
+	std::unique_ptr<OutputQueue> m_outputQueue; // Destroyed first because its writer thread uses the stream
 
-	MessageHeader readMessageHeader(InputReader& reader);
+	bool isCborContent(const MessageHeader& header) const;
+	std::string readMessageData(const MessageHeader& header);
+	MessageHeader readMessageHeaderChecked();
+	MessageHeader readMessageHeader();
+	std::size_t bufferedMessageSize() const;
 	static void parseHeaderValue(MessageHeader& header, std::string_view line);
-	static void readNextMessageHeaderField(MessageHeader& header, InputReader& reader);
-	void writeMessageData(const std::string& content);
-	std::string messageHeaderString(const MessageHeader& header);
+	void writeMessageData(const std::string& content, json::Encoding encoding);
 };
 
 /*
@@ -0,0 +1,549 @@
+#include <lsp/io/sharedmemorystream.h>
+
+#ifndef LSP_SHARED_MEMORY_UNSUPPORTED
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+namespace lsp::io{
+namespace{
+
+/*
+ * Shared memory layout
+ *
+ * The memory starts with a header page that is followed by the data of both rings.
+ * Positions only ever grow and are masked with the capacity to get the offset into the data.
+ */
+
+constexpr std::uint32_t Magic      = 0x4d50534c; // "LSPM"
+constexpr std::uint32_t Version    = 1;
+constexpr std::size_t   HeaderSize = 4096;
+
+// Waiting wakes up regularly to find out if the other process exited without closing the stream
+constexpr timespec PeerCheckInterval = {0, 100'000'000};
+
+// A process that didn't attach this long after the stream was created is treated like one that exited
+constexpr auto AttachTimeout = std::chrono::seconds(10);
+
+// States of Header::isAttached
+constexpr std::uint32_t NotAttached = 0;
+constexpr std::uint32_t Attached    = 1;
+constexpr std::uint32_t Withdrawn   = 2; // The creator stopped waiting, so a process that is late must not attach anymore
+
+struct Ring{
+	// Written by the producer
+	alignas(64) std::atomic<std::uint64_t> writePosition;
+	std::atomic<std::uint32_t>             dataAvailable;     // Futex the consumer waits on
+	std::atomic<std::uint32_t>             isConsumerWaiting;
+	std::atomic<std::uint32_t>             isProducerClosed;
+	// Written by the consumer
+	alignas(64) std::atomic<std::uint64_t> readPosition;
+	std::atomic<std::uint32_t>             spaceAvailable;    // Futex the producer waits on
+	std::atomic<std::uint32_t>             isProducerWaiting;
+	std::atomic<std::uint32_t>             isConsumerClosed;
+};
+
+struct Header{
+	std::uint32_t              magic;
+	std::uint32_t              version;
+	std::uint64_t              capacity;
+	std::atomic<std::int32_t>  creatorPid;
+	std::atomic<std::int32_t>  peerPid;
+	std::atomic<std::uint32_t> isAttached; // Futex the creator waits on, see the states above
+	Ring                       rings[2];   // The creator writes to the first one and reads from the second one
+};
+
+static_assert(sizeof(Header) <= HeaderSize);
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free && std::atomic<std::uint32_t>::is_always_lock_free);
+
+[[noreturn]] void throwError(const std::string& message)
+{
+	throw Error(message + ": " + std::strerror(errno));
+}
+
+// The futexes are shared between processes so the private variants can't be used.
+// Returns false if the timeout elapsed.
+bool futexWait(std::atomic<std::uint32_t>& futex, std::uint32_t value, const timespec* timeout)
+{
+	const auto result = syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&futex), FUTEX_WAIT, value, timeout, nullptr, 0);
+	return result == 0 || errno != ETIMEDOUT;
+}
+
+void wake(std::atomic<std::uint32_t>& futex)
+{
+	syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&futex), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+// Counts up so a waiter that read the value before can't miss the change
+void notify(std::atomic<std::uint32_t>& futex)
+{
+	futex.fetch_add(1);
+	wake(futex);
+}
+
+} // namespace
+
+/*
+ * SharedMemoryStream::Impl
+ */
+
+struct SharedMemoryStream::Impl{
+	int                                   m_fd        = -1; // Only kept by the side that created the memory
+	int                                   m_peerPidFd = -1;
+	void*                                 m_memory    = nullptr;
+	std::size_t                           m_size      = 0;
+	Header*                               m_header    = nullptr;
+	Ring*                                 m_input     = nullptr;
+	Ring*                                 m_output    = nullptr;
+	char*                                 m_inputData  = nullptr;
+	char*                                 m_outputData = nullptr;
+	std::uint64_t                         m_capacity  = 0;
+	std::chrono::steady_clock::time_point m_attachDeadline = std::chrono::steady_clock::now() + AttachTimeout;
+	bool                                  m_isCreator = false;
+	bool                                  m_isClosed  = false;
+
+	Impl(int fd, std::size_t size, bool isCreator)
+		: m_size{size}
+		, m_isCreator{isCreator}
+	{
+		m_memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+		if(m_memory == MAP_FAILED)
+			throwError("Failed to map shared memory");
+
+		if(isCreator)
+		{
+			m_fd = fd;
+			m_header = new(m_memory) Header{};
+		}
+		else
+		{
+			m_header = std::launder(static_cast<Header*>(m_memory));
+		}
+
+		m_capacity = (size - HeaderSize) / 2;
+
+		const auto firstData  = static_cast<char*>(m_memory) + HeaderSize;
+		const auto secondData = firstData + m_capacity;
+
+		m_output     = &m_header->rings[isCreator ? 0 : 1];
+		m_input      = &m_header->rings[isCreator ? 1 : 0];
+		m_outputData = isCreator ? firstData : secondData;
+		m_inputData  = isCreator ? secondData : firstData;
+	}
+
+	~Impl()
+	{
+		close();
+		munmap(m_memory, m_size);
+
+		if(m_fd != -1)
+			::close(m_fd);
+
+		if(m_peerPidFd != -1)
+			::close(m_peerPidFd);
+	}
+
+	void close()
+	{
+		if(m_isClosed)
+			return;
+
+		m_isClosed = true;
+		m_output->isProducerClosed.store(1);
+		notify(m_output->dataAvailable);
+		m_input->isConsumerClosed.store(1);
+		notify(m_input->spaceAvailable);
+	}
+
+	bool isPeerAlive()
+	{
+		const auto pid = m_isCreator ? m_header->peerPid.load() : m_header->creatorPid.load();
+
+		// The other process might still be starting but one that never attaches must not be waited for forever
+		if(pid == 0)
+			return m_header->isAttached.load() == Attached || std::chrono::steady_clock::now() < m_attachDeadline || !withdraw();
+#ifdef SYS_pidfd_open
+		// Unlike kill, a pidfd also tells if a child that wasn't waited for yet exited
+		if(m_peerPidFd == -1)
+			m_peerPidFd = static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+
+		if(m_peerPidFd != -1)
+		{
+			pollfd pollFd{m_peerPidFd, POLLIN, 0};
+			return ::poll(&pollFd, 1, 0) == 0;
+		}
+#endif
+		return kill(pid, 0) == 0 || errno == EPERM;
+	}
+
+	// Keeps a process that is late from attaching. Returns false if it attached already.
+	bool withdraw()
+	{
+		auto state = NotAttached;
+		return m_header->isAttached.compare_exchange_strong(state, Withdrawn) || state == Withdrawn;
+	}
+
+	// Returns nullptr if the creator stopped waiting for this process
+	static std::unique_ptr<Impl> attach(int descriptor)
+	{
+		struct stat status;
+
+		if(fstat(descriptor, &status) != 0)
+		{
+			const auto error = errno;
+			::close(descriptor);
+			throw Error(std::string("Failed to attach to shared memory: ") + std::strerror(error));
+		}
+
+		const auto size = static_cast<std::size_t>(status.st_size);
+
+		if(size <= HeaderSize)
+		{
+			::close(descriptor);
+			throw Error("Failed to attach to shared memory: Invalid size");
+		}
+
+		std::unique_ptr<Impl> impl;
+
+		try
+		{
+			impl = std::make_unique<Impl>(descriptor, size, false);
+		}
+		catch(...)
+		{
+			::close(descriptor);
+			throw;
+		}
+
+		// The mapping stays valid without the descriptor
+		::close(descriptor);
+
+		const auto& header = *impl->m_header;
+
+		// Closing must not touch memory that belongs to others
+		if(header.magic != Magic || header.version != Version || HeaderSize + 2 * header.capacity != size)
+		{
+			impl->m_isClosed = true;
+			throw Error("Failed to attach to shared memory: Invalid header");
+		}
+
+		auto state = NotAttached;
+
+		if(!impl->m_header->isAttached.compare_exchange_strong(state, Attached))
+		{
+			impl->m_isClosed = true;
+
+			if(state == Withdrawn)
+				return nullptr;
+
+			throw Error("Failed to attach to shared memory: Another process is already attached");
+		}
+
+		impl->m_header->peerPid.store(getpid());
+		wake(impl->m_header->isAttached);
+
+		return impl;
+	}
+
+	// Returns false if the other process exited while waiting
+	template<typename Condition>
+	bool waitFor(std::atomic<std::uint32_t>& futex, std::atomic<std::uint32_t>& isWaiting, Condition condition)
+	{
+		const auto value = futex.load();
+		auto       isAlive = true;
+
+		// The other side only wakes this one if it sees the flag after making the condition true
+		isWaiting.store(1);
+
+		if(!condition() && !futexWait(futex, value, &PeerCheckInterval))
+			isAlive = isPeerAlive();
+
+		isWaiting.store(0, std::memory_order_relaxed);
+
+		return isAlive;
+	}
+
+	std::size_t readSome(char* buffer, std::size_t size)
+	{
+		if(size == 0)
+			return 0;
+
+		auto&      ring         = *m_input;
+		const auto readPosition = ring.readPosition.load(std::memory_order_relaxed);
+
+		while(true)
+		{
+			const auto available = ring.writePosition.load(std::memory_order_acquire) - readPosition;
+
+			// The positions are in memory that the other process can write to
+			if(available > m_capacity)
+				throw Error("Failed to read from shared memory stream: Invalid write position");
+
+			if(available > 0)
+			{
+				const auto count  = std::min<std::uint64_t>(available, size);
+				const auto offset = readPosition & (m_capacity - 1);
+				const auto first  = std::min(count, m_capacity - offset);
+
+				std::memcpy(buffer, m_inputData + offset, first);
+				std::memcpy(buffer + first, m_inputData, count - first);
+				ring.readPosition.store(readPosition + count);
+
+				if(ring.isProducerWaiting.load())
+					notify(ring.spaceAvailable);
+
+				return static_cast<std::size_t>(count);
+			}
+
+			// Everything that was written before closing is read first
+			if(ring.isProducerClosed.load())
+			{
+				if(ring.writePosition.load() != readPosition)
+					continue;
+
+				return 0;
+			}
+
+			const auto isAlive = waitFor(ring.dataAvailable, ring.isConsumerWaiting, [&ring, readPosition]()
+			{
+				return ring.writePosition.load() != readPosition || ring.isProducerClosed.load() != 0;
+			});
+
+			if(!isAlive && ring.writePosition.load() == readPosition)
+				return 0;
+		}
+	}
+
+	void writeBuffers(std::span<const std::string_view> buffers)
+	{
+		auto& ring              = *m_output;
+		auto  writePosition     = ring.writePosition.load(std::memory_order_relaxed);
+		auto  publishedPosition = writePosition;
+
+		for(auto buffer : buffers)
+		{
+			while(!buffer.empty())
+			{
+				if(ring.isConsumerClosed.load())
+					throw Error("Failed to write to shared memory stream: The other side was closed");
+
+				const auto used = writePosition - ring.readPosition.load(std::memory_order_acquire);
+
+				if(used > m_capacity)
+					throw Error("Failed to write to shared memory stream: Invalid read position");
+
+				const auto space = m_capacity - used;
+
+				if(space == 0)
+				{
+					// The reader has to see what was written so far before it can make room
+					publish(ring, writePosition);
+					publishedPosition = writePosition;
+
+					const auto isAlive = waitFor(ring.spaceAvailable, ring.isProducerWaiting, [this, &ring, writePosition]()
+					{
+						return writePosition - ring.readPosition.load() < m_capacity || ring.isConsumerClosed.load() != 0;
+					});
+
+					if(!isAlive)
+						throw Error("Failed to write to shared memory stream: The other process exited");
+
+					continue;
+				}
+
+				const auto count  = std::min<std::uint64_t>(space, buffer.size());
+				const auto offset = writePosition & (m_capacity - 1);
+				const auto first  = std::min(count, m_capacity - offset);
+
+				std::memcpy(m_outputData + offset, buffer.data(), first);
+				std::memcpy(m_outputData, buffer.data() + first, count - first);
+				writePosition += count;
+				buffer.remove_prefix(count);
+
+				// Large writes are passed on in parts so the reader can start copying early
+				if(writePosition - publishedPosition >= m_capacity / 4)
+				{
+					publish(ring, writePosition);
+					publishedPosition = writePosition;
+				}
+			}
+		}
+
+		if(writePosition != publishedPosition)
+			publish(ring, writePosition);
+	}
+
+	void publish(Ring& ring, std::uint64_t writePosition)
+	{
+		ring.writePosition.store(writePosition);
+
+		if(ring.isConsumerWaiting.load())
+			notify(ring.dataAvailable);
+	}
+};
+
+/*
+ * SharedMemoryStream
+ */
+
+SharedMemoryStream::SharedMemoryStream(SharedMemoryStream&&) = default;
+SharedMemoryStream& SharedMemoryStream::operator=(SharedMemoryStream&&) = default;
+SharedMemoryStream::~SharedMemoryStream() = default;
+
+SharedMemoryStream::SharedMemoryStream(std::unique_ptr<Impl> impl)
+	: m_impl{std::move(impl)}
+{
+}
+
+SharedMemoryStream SharedMemoryStream::create(std::size_t capacity)
+{
+	capacity = std::bit_ceil(std::max(capacity, HeaderSize));
+
+	const auto fd = memfd_create("lsp-shared-memory", MFD_CLOEXEC);
+
+	if(fd == -1)
+		throwError("Failed to create shared memory");
+
+	const auto size = HeaderSize + 2 * capacity;
+
+	if(ftruncate(fd, static_cast<off_t>(size)) != 0)
+	{
+		const auto error = errno;
+		::close(fd);
+		throw Error(std::string("Failed to resize shared memory: ") + std::strerror(error));
+	}
+
+	std::unique_ptr<Impl> impl;
+
+	try
+	{
+		impl = std::make_unique<Impl>(fd, size, true);
+	}
+	catch(...)
+	{
+		::close(fd);
+		throw;
+	}
+
+	impl->m_header->magic    = Magic;
+	impl->m_header->version  = Version;
+	impl->m_header->capacity = capacity;
+	impl->m_header->creatorPid.store(getpid());
+
+	return SharedMemoryStream(std::move(impl));
+}
+
+SharedMemoryStream SharedMemoryStream::attach(int descriptor)
+{
+	auto impl = Impl::attach(descriptor);
+
+	if(!impl)
+		throw Error("Failed to attach to shared memory: The other process stopped waiting for it");
+
+	return SharedMemoryStream(std::move(impl));
+}
+
+std::optional<SharedMemoryStream> SharedMemoryStream::fromEnvironment()
+{
+	const auto* value = std::getenv(EnvironmentVariable);
+
+	if(!value)
+		return std::nullopt;
+
+	const auto descriptor = std::atoi(value);
+
+	// Processes started by this one must not attach to it as well
+	unsetenv(EnvironmentVariable);
+
+	if(descriptor <= STDERR_FILENO || fcntl(descriptor, F_GETFD) == -1)
+		return std::nullopt;
+
+	// The standard I/O is used instead if the other process stopped waiting
+	auto impl = Impl::attach(descriptor);
+
+	if(!impl)
+		return std::nullopt;
+
+	return SharedMemoryStream(std::move(impl));
+}
+
+int SharedMemoryStream::descriptor() const
+{
+	return m_impl ? m_impl->m_fd : -1;
+}
+
+bool SharedMemoryStream::waitForPeer(std::chrono::milliseconds timeout)
+{
+	auto&      isAttached = m_impl->m_header->isAttached;
+	const auto deadline   = std::chrono::steady_clock::now() + timeout;
+
+	while(isAttached.load() == NotAttached)
+	{
+		const auto remaining = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - std::chrono::steady_clock::now());
+
+		if(remaining.count() <= 0)
+			return !m_impl->withdraw();
+
+		const auto waitTime = timespec{static_cast<time_t>(remaining.count() / 1'000'000'000), static_cast<long>(remaining.count() % 1'000'000'000)};
+		futexWait(isAttached, NotAttached, &waitTime);
+	}
+
+	return isAttached.load() == Attached;
+}
+
+void SharedMemoryStream::close()
+{
+	if(m_impl)
+		m_impl->close();
+}
+
+void SharedMemoryStream::read(char* buffer, std::size_t size)
+{
+	while(size > 0)
+	{
+		const auto bytesRead = m_impl->readSome(buffer, size);
+
+		if(bytesRead == 0)
+			throw Error("Failed to read from shared memory stream: Unexpected end of stream");
+
+		buffer += bytesRead;
+		size -= bytesRead;
+	}
+}
+
+void SharedMemoryStream::write(const char* buffer, std::size_t size)
+{
+	const std::string_view buffers[] = {{buffer, size}};
+	m_impl->writeBuffers(buffers);
+}
+
+std::size_t SharedMemoryStream::readSome(char* buffer, std::size_t size)
+{
+	return m_impl->readSome(buffer, size);
+}
+
+void SharedMemoryStream::writeBuffers(std::span<const std::string_view> buffers)
+{
+	m_impl->writeBuffers(buffers);
+}
+
+} // namespace lsp::io
+
+#endif // LSP_SHARED_MEMORY_UNSUPPORTED
@@ -0,0 +1,72 @@
+#pragma once
+
+#ifdef __linux__
+	#define LSP_SHARED_MEMORY_LINUX
+#else
+	#define LSP_SHARED_MEMORY_UNSUPPORTED
+#endif
+
+#ifndef LSP_SHARED_MEMORY_UNSUPPORTED
+
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <lsp/io/stream.h>
+
+namespace lsp::io{
+
+/*
+ * SharedMemoryStream
+ *
+ * Connects two processes on the same machine through a pair of ring buffers in shared memory (Linux only).
+ * Writing copies the data into the ring of the other process and only wakes it with a futex if it is waiting,
+ * so large messages don't have to be passed through a pipe in many small system calls.
+ *
+ * One process creates the stream and passes its descriptor on to the other one which attaches to it.
+ * lsp::Process does this when it is started with a stream and the process attaches with fromEnvironment.
+ * Every side can only be used by one reading and one writing thread at a time which lsp::Connection ensures.
+ */
+class SharedMemoryStream : public Stream{
+public:
+	static constexpr std::size_t DefaultCapacity     = 4 * 1024 * 1024; // Per direction
+	static constexpr auto        EnvironmentVariable = "LSP_SHARED_MEMORY_FD";
+
+	SharedMemoryStream(SharedMemoryStream&&);
+	SharedMemoryStream& operator=(SharedMemoryStream&&);
+	~SharedMemoryStream() override;
+
+	// The capacity is rounded up to a power of two
+	[[nodiscard]] static SharedMemoryStream create(std::size_t capacity = DefaultCapacity);
+	// Takes over the descriptor
+	[[nodiscard]] static SharedMemoryStream attach(int descriptor);
+	// Attaches to the stream that was passed on by the process that started this one, if there is one and it still waits for it
+	[[nodiscard]] static std::optional<SharedMemoryStream> fromEnvironment();
+
+	// The descriptor of the shared memory, only valid for the side that created it, otherwise -1
+	[[nodiscard]] int descriptor() const;
+	/*
+	 * Waits until the other side attached. Returns false on timeout, e.g. if the other process doesn't support it.
+	 * The stream can't be attached to anymore after a timeout, so a process that is late uses its standard I/O
+	 * instead of waiting on a stream that is never read from. Reading and writing before the other side attached
+	 * gives up the same way after a while.
+	 */
+	[[nodiscard]] bool waitForPeer(std::chrono::milliseconds timeout);
+
+	// The other side reads the end of the stream once it read everything that was written
+	void close();
+
+	void read(char* buffer, std::size_t size) override;
+	void write(const char* buffer, std::size_t size) override;
+	std::size_t readSome(char* buffer, std::size_t size) override;
+	void writeBuffers(std::span<const std::string_view> buffers) override;
+
+private:
+	struct Impl;
+	std::unique_ptr<Impl> m_impl;
+
+	SharedMemoryStream(std::unique_ptr<Impl> impl);
+};
+
+} // namespace lsp::io
+
+#endif // LSP_SHARED_MEMORY_UNSUPPORTED
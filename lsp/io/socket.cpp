@@ -1,15 +1,25 @@
 #include <lsp/io/socket.h>
+#include <lsp/io/writebatch.h>
 
 #ifndef LSP_SOCKET_UNSUPPORTED
 
+#include <algorithm>
 #include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
 
 #ifdef LSP_SOCKET_POSIX
 #include <cerrno>
+#include <fcntl.h>
 #include <netdb.h>
+#include <poll.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
 #include <netinet/in.h>
 #elif defined LSP_SOCKET_WIN32
 #define WIN32_LEAN_AND_MEAN
@@ -17,6 +27,7 @@
 #include <WinSock2.h>
 #include <WS2tcpip.h>
 #include <iphlpapi.h>
+#include <afunix.h>
 #include <mutex> // std::call_once
 #endif
 
@@ -48,7 +59,12 @@ struct Socket::Impl{
 #endif
 
 	SocketHandle   m_socketFd       = InvalidSocket;
-	unsigned short m_maxConnections = 1; // Only relevant for listen
+	unsigned short m_maxConnections = 1;     // Only relevant for listen
+	bool           m_nonBlocking    = false; // Only relevant for listen
+	std::string    m_localPath;              // Only relevant for listen, removed together with the socket
+#ifdef LSP_SOCKET_POSIX
+	struct stat    m_localFile      = {};    // Tells the file of the socket apart from a newer one at the same path
+#endif
 
 	Impl(SocketHandle socket, unsigned short maxConnections = 1)
 		: m_socketFd(socket)
@@ -59,6 +75,19 @@ struct Socket::Impl{
 	~Impl()
 	{
 		closeSocketHandle(m_socketFd);
+
+		if(!m_localPath.empty())
+		{
+#ifdef LSP_SOCKET_POSIX
+			struct stat status;
+
+			if(lstat(m_localPath.c_str(), &status) == 0 && isSameFile(status, m_localFile))
+				unlink(m_localPath.c_str());
+#else
+			auto error = std::error_code();
+			std::filesystem::remove(m_localPath, error);
+#endif
+		}
 	}
 
 	static void closeSocketHandle(SocketHandle handle)
@@ -131,6 +160,121 @@ struct Socket::Impl{
 		return std::make_unique<Impl>(socketFd, maxConnections);
 	}
 
+	// Names starting with '@' are in the abstract namespace which doesn't need a file
+	static bool isAbstractLocalPath(const std::string& path)
+	{
+		return !path.empty() && path.front() == '@';
+	}
+
+	static sockaddr_un localAddress(const std::string& path, SizeType& size)
+	{
+		auto addr = sockaddr_un{};
+		addr.sun_family = AF_UNIX;
+
+		if(path.empty() || path.size() >= sizeof(addr.sun_path))
+			throw Error("Invalid local socket path '" + path + '\'');
+
+		std::memcpy(addr.sun_path, path.data(), path.size());
+		size = static_cast<SizeType>(offsetof(sockaddr_un, sun_path) + path.size() + 1);
+
+		if(isAbstractLocalPath(path))
+		{
+#ifdef __linux__
+			// Abstract names start with a null byte instead and are not null terminated
+			addr.sun_path[0] = '\0';
+			--size;
+#else
+			throw Error("Abstract local socket names are only supported on Linux");
+#endif
+		}
+
+		return addr;
+	}
+
+#ifdef LSP_SOCKET_POSIX
+	// Inode numbers are reused so the time of the last status change has to match as well
+	static bool isSameFile(const struct stat& a, const struct stat& b)
+	{
+		return a.st_dev == b.st_dev && a.st_ino == b.st_ino &&
+		       a.st_ctim.tv_sec == b.st_ctim.tv_sec && a.st_ctim.tv_nsec == b.st_ctim.tv_nsec;
+	}
+#endif
+
+	// A socket file that was left behind by a server that exited would make bind fail. It is only removed if nothing
+	// accepts connections on it anymore, so neither other files nor the socket of a running server are deleted.
+	static void removeStaleLocalSocket([[maybe_unused]] const std::string& path, [[maybe_unused]] const sockaddr_un& addr, [[maybe_unused]] SizeType addrSize)
+	{
+#ifdef LSP_SOCKET_POSIX
+		struct stat status;
+
+		if(lstat(path.c_str(), &status) != 0)
+			return;
+
+		if(!S_ISSOCK(status.st_mode))
+			throw Error("Failed to bind socket address: '" + path + "' exists and is not a socket");
+
+		const auto probeFd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+		if(probeFd == InvalidSocket)
+			throwError("Failed to create socket");
+
+		// Non-blocking so a server with a full backlog doesn't make this wait
+		fcntl(probeFd, F_SETFL, fcntl(probeFd, F_GETFL) | O_NONBLOCK);
+
+		const auto result = ::connect(probeFd, reinterpret_cast<const sockaddr*>(&addr), addrSize);
+		const auto error  = errno;
+		closeSocketHandle(probeFd);
+
+		if(result == 0 || error != ECONNREFUSED)
+			throw Error("Failed to bind socket address: '" + path + "' is used by another server");
+
+		if(unlink(path.c_str()) != 0 && errno != ENOENT)
+			throwError("Failed to remove stale socket '" + path + '\'');
+#endif
+	}
+
+	[[nodiscard]]
+	static std::unique_ptr<Impl> setupForListenLocal(const std::string& path, unsigned short maxConnections)
+	{
+		ensureInitialized();
+
+		SizeType   addrSize;
+		const auto addr = localAddress(path, addrSize);
+
+		if(!isAbstractLocalPath(path))
+			removeStaleLocalSocket(path, addr, addrSize);
+
+		const auto socketFd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+		if(socketFd == InvalidSocket)
+			throwError("Failed to create socket");
+
+		if(bind(socketFd, reinterpret_cast<const sockaddr*>(&addr), addrSize) != 0)
+		{
+			closeSocketHandle(socketFd);
+			throwError("Failed to bind socket address");
+		}
+
+		// Listening right away refuses no connection, which is how a stale socket is told apart from a running server
+		if(::listen(socketFd, maxConnections) == -1)
+		{
+			closeSocketHandle(socketFd);
+			throwError("Failed to listen for new socket connections");
+		}
+
+		auto impl = std::make_unique<Impl>(socketFd, maxConnections);
+
+		if(!isAbstractLocalPath(path))
+		{
+			impl->m_localPath = path;
+#ifdef LSP_SOCKET_POSIX
+			lstat(path.c_str(), &impl->m_localFile);
+#endif
+		}
+
+		return impl;
+	}
+
 	[[nodiscard]]
 	static std::unique_ptr<Impl> connect(const std::string& address, unsigned short port)
 	{
@@ -166,6 +310,27 @@ struct Socket::Impl{
 		throwError("Failed to connect to any resolved address");
 	}
 
+	[[nodiscard]]
+	static std::unique_ptr<Impl> connectLocal(const std::string& path)
+	{
+		ensureInitialized();
+
+		SizeType   addrSize;
+		const auto addr = localAddress(path, addrSize);
+		const auto socketFd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+		if(socketFd == InvalidSocket)
+			throwError("Failed to create socket");
+
+		if(::connect(socketFd, reinterpret_cast<const sockaddr*>(&addr), addrSize) != 0)
+		{
+			closeSocketHandle(socketFd);
+			throwError("Failed to connect to '" + path + '\'');
+		}
+
+		return std::make_unique<Impl>(socketFd);
+	}
+
 	std::unique_ptr<Impl> listen()
 	{
 		assert(m_socketFd != InvalidSocket);
@@ -173,13 +338,68 @@ struct Socket::Impl{
 		if(::listen(m_socketFd, m_maxConnections) == -1)
 			throwError("Failed to listen for new socket connections");
 
-		const auto other = accept(m_socketFd, nullptr, nullptr);
+		while(true)
+		{
+			const auto other = accept(m_socketFd, nullptr, nullptr);
+
+			if(other != InvalidSocket)
+				return std::make_unique<Impl>(other);
+#ifdef LSP_SOCKET_POSIX
+			if(errno == EINTR)
+				continue;
 
-		if(other == InvalidSocket)
+			// The socket is non-blocking once tryListen was called
+			if(errno == EAGAIN || errno == EWOULDBLOCK)
+			{
+				pollfd pollFd{m_socketFd, POLLIN, 0};
+				::poll(&pollFd, 1, -1);
+				continue;
+			}
+#endif
 			throwError("Failed to accept socket connection");
+		}
+	}
+
+#ifdef LSP_SOCKET_POSIX
+	// Returns nullptr if there is no pending connection
+	std::unique_ptr<Impl> tryListen()
+	{
+		assert(m_socketFd != InvalidSocket);
+
+		if(!m_nonBlocking)
+		{
+			if(::listen(m_socketFd, m_maxConnections) == -1)
+				throwError("Failed to listen for new socket connections");
+
+			if(fcntl(m_socketFd, F_SETFL, fcntl(m_socketFd, F_GETFL) | O_NONBLOCK) == -1)
+				throwError("Failed to make socket non-blocking");
+
+			m_nonBlocking = true;
+		}
+
+		while(true)
+		{
+			const auto other = accept(m_socketFd, nullptr, nullptr);
+
+			if(other != InvalidSocket)
+			{
+#ifndef __linux__
+				// Other systems pass the flag on to accepted sockets
+				fcntl(other, F_SETFL, fcntl(other, F_GETFL) & ~O_NONBLOCK);
+#endif
+				return std::make_unique<Impl>(other);
+			}
 
-		return std::make_unique<Impl>(other);
+			if(errno == EINTR || errno == ECONNABORTED)
+				continue;
+
+			if(errno == EAGAIN || errno == EWOULDBLOCK)
+				return nullptr;
+
+			throwError("Failed to accept socket connection");
+		}
 	}
+#endif
 
 	void read(char* buffer, std::size_t size)
 	{
@@ -202,6 +422,99 @@ struct Socket::Impl{
 		}
 	}
 
+	std::size_t readSome(char* buffer, std::size_t size)
+	{
+		if(size == 0)
+			return 0;
+
+		while(true)
+		{
+			const auto bytesRead = recv(m_socketFd, buffer, static_cast<SizeType>(size), 0);
+#ifdef LSP_SOCKET_POSIX
+			if(bytesRead < 0 && errno == EINTR)
+				continue;
+#endif
+			if(bytesRead < 0)
+				throwError("Failed to read from socket");
+
+			return static_cast<std::size_t>(bytesRead);
+		}
+	}
+
+#ifdef LSP_SOCKET_POSIX
+	std::optional<std::size_t> tryReadSome(char* buffer, std::size_t size)
+	{
+		if(size == 0)
+			return 0;
+
+		while(true)
+		{
+			const auto bytesRead = recv(m_socketFd, buffer, size, MSG_DONTWAIT);
+
+			if(bytesRead >= 0)
+				return static_cast<std::size_t>(bytesRead);
+
+			if(errno == EINTR)
+				continue;
+
+			if(errno == EAGAIN || errno == EWOULDBLOCK)
+				return std::nullopt;
+
+			throwError("Failed to read from socket");
+		}
+	}
+
+	std::size_t tryWriteBuffers(std::span<const std::string_view> buffers)
+	{
+		// A peer that went away must not take down a process serving many connections with SIGPIPE
+#ifdef MSG_NOSIGNAL
+		constexpr int NonBlockingSendFlags = MSG_DONTWAIT | MSG_NOSIGNAL;
+#else
+		constexpr int NonBlockingSendFlags = MSG_DONTWAIT;
+#endif
+		std::size_t totalBytesWritten = 0;
+
+		while(!buffers.empty())
+		{
+			const auto  batchSize  = std::min(buffers.size(), MaxWriteBatchSize);
+			std::size_t batchBytes = 0;
+			iovec       vectors[MaxWriteBatchSize];
+
+			for(std::size_t i = 0; i < batchSize; ++i)
+			{
+				vectors[i] = {const_cast<char*>(buffers[i].data()), buffers[i].size()};
+				batchBytes += buffers[i].size();
+			}
+
+			auto message = msghdr{};
+			message.msg_iov    = vectors;
+			message.msg_iovlen = static_cast<decltype(message.msg_iovlen)>(batchSize);
+
+			const auto bytesWritten = sendmsg(m_socketFd, &message, NonBlockingSendFlags);
+
+			if(bytesWritten < 0)
+			{
+				if(errno == EINTR)
+					continue;
+
+				if(errno == EAGAIN || errno == EWOULDBLOCK)
+					break;
+
+				throwError("Failed to write to socket");
+			}
+
+			totalBytesWritten += static_cast<std::size_t>(bytesWritten);
+
+			if(static_cast<std::size_t>(bytesWritten) < batchBytes)
+				break;
+
+			buffers = buffers.subspan(batchSize);
+		}
+
+		return totalBytesWritten;
+	}
+#endif
+
 	void write(const char* buffer, std::size_t size)
 	{
 		if(size == 0)
@@ -222,6 +535,49 @@ struct Socket::Impl{
 			totalBytesWritten += bytesWritten;
 		}
 	}
+
+	void writeBuffers(std::span<const std::string_view> buffers)
+	{
+		while(!buffers.empty())
+		{
+			const auto batchSize = std::min(buffers.size(), MaxWriteBatchSize);
+#ifdef LSP_SOCKET_POSIX
+			iovec vectors[MaxWriteBatchSize];
+
+			for(std::size_t i = 0; i < batchSize; ++i)
+				vectors[i] = {const_cast<char*>(buffers[i].data()), buffers[i].size()};
+
+			for(auto remaining = std::span{vectors, batchSize}; !remaining.empty();)
+			{
+				const auto bytesWritten = writev(m_socketFd, remaining.data(), static_cast<int>(remaining.size()));
+
+				if(bytesWritten < 0 && errno == EINTR)
+					continue;
+
+				if(bytesWritten <= 0)
+					throwError("Failed to write to socket");
+
+				skipWritten(remaining, static_cast<std::size_t>(bytesWritten));
+			}
+#elif defined(LSP_SOCKET_WIN32)
+			WSABUF vectors[MaxWriteBatchSize];
+
+			for(std::size_t i = 0; i < batchSize; ++i)
+				vectors[i] = {static_cast<ULONG>(buffers[i].size()), const_cast<CHAR*>(buffers[i].data())};
+
+			for(auto remaining = std::span{vectors, batchSize}; !remaining.empty();)
+			{
+				DWORD bytesWritten = 0;
+
+				if(WSASend(m_socketFd, remaining.data(), static_cast<DWORD>(remaining.size()), &bytesWritten, 0, nullptr, nullptr) != 0)
+					throwError("Failed to write to socket");
+
+				skipWritten(remaining, bytesWritten);
+			}
+#endif
+			buffers = buffers.subspan(batchSize);
+		}
+	}
 };
 
 /*
@@ -242,6 +598,11 @@ Socket Socket::connect(const std::string& address, unsigned short port)
 	return Socket(Impl::connect(address, port));
 }
 
+Socket Socket::connectLocal(const std::string& path)
+{
+	return Socket(Impl::connectLocal(path));
+}
+
 bool Socket::isOpen() const
 {
 	return !!m_impl;
@@ -264,6 +625,52 @@ void Socket::write(const char* buffer, std::size_t size)
 	m_impl->write(buffer, size);
 }
 
+std::size_t Socket::readSome(char* buffer, std::size_t size)
+{
+	assert(m_impl);
+	return m_impl->readSome(buffer, size);
+}
+
+void Socket::writeBuffers(std::span<const std::string_view> buffers)
+{
+	assert(m_impl);
+	m_impl->writeBuffers(buffers);
+}
+
+int Socket::readDescriptor() const
+{
+#ifdef LSP_SOCKET_POSIX
+	return m_impl ? m_impl->m_socketFd : -1;
+#else
+	return -1;
+#endif
+}
+
+int Socket::writeDescriptor() const
+{
+	return readDescriptor();
+}
+
+std::optional<std::size_t> Socket::tryReadSome(char* buffer, std::size_t size)
+{
+	assert(m_impl);
+#ifdef LSP_SOCKET_POSIX
+	return m_impl->tryReadSome(buffer, size);
+#else
+	return Stream::tryReadSome(buffer, size);
+#endif
+}
+
+std::size_t Socket::tryWriteBuffers(std::span<const std::string_view> buffers)
+{
+	assert(m_impl);
+#ifdef LSP_SOCKET_POSIX
+	return m_impl->tryWriteBuffers(buffers);
+#else
+	return Stream::tryWriteBuffers(buffers);
+#endif
+}
+
 /*
  * SocketListener
  */
@@ -273,6 +680,16 @@ SocketListener::SocketListener(unsigned short port, unsigned short maxConnection
 {
 }
 
+SocketListener::SocketListener(Socket&& socket)
+	: m_socket(std::move(socket))
+{
+}
+
+SocketListener SocketListener::local(const std::string& path, unsigned short maxConnections)
+{
+	return SocketListener(Socket(Socket::Impl::setupForListenLocal(path, maxConnections)));
+}
+
 Socket SocketListener::listen()
 {
 	if(!isReady())
@@ -281,6 +698,21 @@ Socket SocketListener::listen()
 	return Socket(m_socket.m_impl->listen());
 }
 
+std::optional<Socket> SocketListener::tryListen()
+{
+	if(!isReady())
+		throw Error("Server socket is not open for listening");
+
+#ifdef LSP_SOCKET_POSIX
+	if(auto impl = m_socket.m_impl->tryListen(); impl)
+		return Socket(std::move(impl));
+
+	return std::nullopt;
+#else
+	return listen();
+#endif
+}
+
 } // namespace lsp::io
 
 #endif // LSP_SOCKET_UNSUPPORTED
@@ -29,12 +29,21 @@ public:
 	~Socket() override;
 
 	[[nodiscard]] static Socket connect(const std::string& address, unsigned short port);
+	// Connects to a Unix domain socket. Names starting with '@' are in the abstract namespace (Linux only).
+	[[nodiscard]] static Socket connectLocal(const std::string& path);
 
 	[[nodiscard]] bool isOpen() const;
 	void close();
 
 	void read(char* buffer, std::size_t size) override;
 	void write(const char* buffer, std::size_t size) override;
+	std::size_t readSome(char* buffer, std::size_t size) override;
+	void writeBuffers(std::span<const std::string_view> buffers) override;
+
+	int readDescriptor() const override;
+	int writeDescriptor() const override;
+	std::optional<std::size_t> tryReadSome(char* buffer, std::size_t size) override;
+	std::size_t tryWriteBuffers(std::span<const std::string_view> buffers) override;
 
 private:
 	friend class SocketListener;
@@ -51,13 +60,22 @@ private:
 class SocketListener{
 public:
 	SocketListener(unsigned short port, unsigned short maxConnections = 32);
+	// Listens on a Unix domain socket. A socket file at path that a server which exited left behind is replaced.
+	// Throws if the path is another kind of file or another server still listens on it.
+	// The file is removed again with the listener unless another listener was bound to the path in the meantime.
+	[[nodiscard]] static SocketListener local(const std::string& path, unsigned short maxConnections = 32);
 
 	[[nodiscard]] Socket listen();
+	// Accepts a pending connection without waiting for one. Always waits on Windows.
+	[[nodiscard]] std::optional<Socket> tryListen();
+	[[nodiscard]] int readDescriptor() const{ return m_socket.readDescriptor(); }
 	[[nodiscard]] bool isReady() const{ return m_socket.isOpen(); }
 	void shutdown(){ m_socket.close(); }
 
 private:
 	Socket m_socket;
+
+	SocketListener(Socket&& socket);
 };
 
 } // namespace lsp::io
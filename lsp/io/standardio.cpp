@@ -1,24 +1,32 @@
 #ifdef _WIN32
 #include <io.h>
 #include <fcntl.h>
+#else
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/uio.h>
 #endif
+#include <algorithm>
 #include <cerrno>
 #include <cstdio>
 #include <cstring>
+#include <string>
 #include <lsp/io/stream.h>
 #include <lsp/io/standardio.h>
+#include <lsp/io/writebatch.h>
 
 namespace lsp::io{
 namespace{
 
+#ifdef _WIN32
+
 class StandardIOStream : public Stream{
 public:
 	StandardIOStream()
 	{
-#ifdef _WIN32
 		_setmode(_fileno(stdin), _O_BINARY);
 		_setmode(_fileno(stdout), _O_BINARY);
-#endif
 	}
 
 	void read(char* buffer, std::size_t size) override
@@ -36,6 +44,197 @@ public:
 	}
 };
 
+#else
+
+/*
+ * Reads and writes the descriptors of stdin and stdout directly instead of going through the buffers of FILE.
+ * Every call to write or writeBuffers results in a single write so a message or a batch of them is flushed at once.
+ * Reads go directly to the buffer of the caller.
+ *
+ * The descriptors are only made non-blocking once an event loop uses them and get their original flags back on exit.
+ * Until then anything buffered in stdout is flushed before writing. Afterwards it isn't since flushing a non-blocking
+ * descriptor can fail and drop the buffered output, so stdout should not be used along with an event loop.
+ */
+class StandardIOStream : public Stream{
+public:
+	~StandardIOStream() override
+	{
+		restoreFlags(STDIN_FILENO, m_originalInputFlags);
+		restoreFlags(STDOUT_FILENO, m_originalOutputFlags);
+	}
+
+	void read(char* buffer, std::size_t size) override
+	{
+		while(size > 0)
+		{
+			const auto bytesRead = readSome(buffer, size);
+
+			if(bytesRead == 0)
+				throw Error("Failed to read from stdin: Unexpected end of stream");
+
+			buffer += bytesRead;
+			size -= bytesRead;
+		}
+	}
+
+	void write(const char* buffer, std::size_t size) override
+	{
+		const std::string_view buffers[] = {{buffer, size}};
+		writeBuffers(buffers);
+	}
+
+	std::size_t readSome(char* buffer, std::size_t size) override
+	{
+		return *readSome(buffer, size, true);
+	}
+
+	void writeBuffers(std::span<const std::string_view> buffers) override
+	{
+		writeBuffers(buffers, true);
+	}
+
+	int readDescriptor() const override{ return STDIN_FILENO; }
+	int writeDescriptor() const override{ return STDOUT_FILENO; }
+
+	std::optional<std::size_t> tryReadSome(char* buffer, std::size_t size) override
+	{
+		makeNonBlocking(STDIN_FILENO, m_originalInputFlags);
+		return readSome(buffer, size, false);
+	}
+
+	std::size_t tryWriteBuffers(std::span<const std::string_view> buffers) override
+	{
+		if(!m_originalOutputFlags.has_value())
+			flushStandardOutput();
+
+		makeNonBlocking(STDOUT_FILENO, m_originalOutputFlags);
+		return writeBuffers(buffers, false);
+	}
+
+private:
+	std::optional<int> m_originalInputFlags;  // Set once the descriptor was made non-blocking
+	std::optional<int> m_originalOutputFlags;
+
+	[[noreturn]] static void throwError(const std::string& message)
+	{
+		throw Error(message + ": " + std::strerror(errno));
+	}
+
+	// The descriptors are shared with other processes so they are only changed once an event loop needs it
+	static void makeNonBlocking(int fd, std::optional<int>& originalFlags)
+	{
+		if(originalFlags.has_value())
+			return;
+
+		const auto flags = fcntl(fd, F_GETFL);
+
+		if(flags == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1)
+			throwError("Failed to make standard I/O non-blocking");
+
+		originalFlags = flags;
+	}
+
+	static void restoreFlags(int fd, const std::optional<int>& originalFlags)
+	{
+		if(originalFlags.has_value())
+			fcntl(fd, F_SETFL, *originalFlags);
+	}
+
+	// Anything still buffered in stdout has to come first
+	static void flushStandardOutput()
+	{
+		if(std::fflush(stdout) != 0)
+			throwError("Failed to flush stdout");
+	}
+
+	// Blocking calls wait if the descriptor is non-blocking, which others might have made it as well
+	static void waitUntilReady(int fd, short events)
+	{
+		pollfd pollFd{fd, events, 0};
+
+		while(::poll(&pollFd, 1, -1) < 0 && errno == EINTR)
+			continue;
+	}
+
+	// Returns std::nullopt if nothing is available without waiting
+	static std::optional<std::size_t> readSome(char* buffer, std::size_t size, bool wait)
+	{
+		if(size == 0)
+			return 0;
+
+		while(true)
+		{
+			const auto bytesRead = ::read(STDIN_FILENO, buffer, size);
+
+			if(bytesRead >= 0)
+				return static_cast<std::size_t>(bytesRead);
+
+			if(errno == EINTR)
+				continue;
+
+			if(errno == EAGAIN || errno == EWOULDBLOCK)
+			{
+				if(!wait)
+					return std::nullopt;
+
+				waitUntilReady(STDIN_FILENO, POLLIN);
+				continue;
+			}
+
+			throwError("Failed to read from stdin");
+		}
+	}
+
+	// Returns the number of bytes written which is only less than the total size if wait is false
+	std::size_t writeBuffers(std::span<const std::string_view> buffers, bool wait)
+	{
+		std::size_t totalBytesWritten = 0;
+
+		if(!m_originalOutputFlags.has_value())
+			flushStandardOutput();
+
+		while(!buffers.empty())
+		{
+			const auto batchSize = std::min(buffers.size(), MaxWriteBatchSize);
+			iovec      vectors[MaxWriteBatchSize];
+
+			for(std::size_t i = 0; i < batchSize; ++i)
+				vectors[i] = {const_cast<char*>(buffers[i].data()), buffers[i].size()};
+
+			for(auto remaining = std::span{vectors, batchSize}; !remaining.empty();)
+			{
+				const auto bytesWritten = ::writev(STDOUT_FILENO, remaining.data(), static_cast<int>(remaining.size()));
+
+				if(bytesWritten < 0)
+				{
+					if(errno == EINTR)
+						continue;
+
+					if(errno == EAGAIN || errno == EWOULDBLOCK)
+					{
+						if(!wait)
+							return totalBytesWritten;
+
+						waitUntilReady(STDOUT_FILENO, POLLOUT);
+						continue;
+					}
+
+					throwError("Failed to write to stdout");
+				}
+
+				totalBytesWritten += static_cast<std::size_t>(bytesWritten);
+				skipWritten(remaining, static_cast<std::size_t>(bytesWritten));
+			}
+
+			buffers = buffers.subspan(batchSize);
+		}
+
+		return totalBytesWritten;
+	}
+};
+
+#endif
+
 }
 
 Stream& standardIO()
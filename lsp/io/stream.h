@@ -1,6 +1,9 @@
 #pragma once
 
 #include <cstddef>
+#include <optional>
+#include <span>
+#include <string_view>
 #include <lsp/exception.h>
 
 namespace lsp::io{
@@ -28,6 +31,60 @@ public:
 	virtual void read(char* buffer, std::size_t size) = 0;
 	virtual void write(const char* buffer, std::size_t size) = 0;
 
+	/*
+	 * Reads up to size bytes and blocks only until at least one byte is available.
+	 * Returns the number of bytes read or 0 if the end of the stream was reached.
+	 * The default implementation reads a single byte so existing streams keep working unchanged.
+	 */
+	virtual std::size_t readSome(char* buffer, std::size_t size)
+	{
+		if(size == 0)
+			return 0;
+
+		*buffer = Eof;
+		read(buffer, 1);
+		return 1;
+	}
+
+	/*
+	 * Writes the buffers in order as if they were a single one.
+	 * The default implementation calls write for each of them. Streams that can pass all of them
+	 * to the system at once should override it so they don't need to be joined before writing.
+	 */
+	virtual void writeBuffers(std::span<const std::string_view> buffers)
+	{
+		for(const auto buffer : buffers)
+			write(buffer.data(), buffer.size());
+	}
+
+	/*
+	 * Non-blocking I/O for event loops like lsp::Reactor.
+	 *
+	 * readDescriptor and writeDescriptor return the file descriptors an event loop waits on
+	 * until the stream is readable or writable or -1 if the stream doesn't have any.
+	 * tryReadSome is like readSome but returns std::nullopt instead of waiting for data.
+	 * tryWriteBuffers writes as much of the buffers as possible without waiting and returns the number of bytes written.
+	 * The default implementations block.
+	 */
+	virtual int readDescriptor() const{ return -1; }
+	virtual int writeDescriptor() const{ return -1; }
+
+	virtual std::optional<std::size_t> tryReadSome(char* buffer, std::size_t size)
+	{
+		return readSome(buffer, size);
+	}
+
+	virtual std::size_t tryWriteBuffers(std::span<const std::string_view> buffers)
+	{
+		std::size_t size = 0;
+
+		for(const auto buffer : buffers)
+			size += buffer.size();
+
+		writeBuffers(buffers);
+		return size;
+	}
+
 protected:
 	Stream() = default;
 	Stream(Stream&&) = default;
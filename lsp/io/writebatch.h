@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+
+namespace lsp::io{
+
+/*
+ * Helpers for streams that pass several buffers to a single system call like writev or WSASend
+ */
+
+// Buffers are passed to the system in batches that stay well below the limit of any platform
+inline constexpr std::size_t MaxWriteBatchSize = 16;
+
+// Removes what a write wrote from the front of the vectors (iovec or WSABUF), which can end in the middle of a buffer
+template<typename Vector>
+void skipWritten(std::span<Vector>& vectors, std::size_t count)
+{
+	if constexpr(requires(Vector vector){ vector.iov_len; })
+	{
+		for(; !vectors.empty() && count >= vectors.front().iov_len; vectors = vectors.subspan(1))
+			count -= vectors.front().iov_len;
+
+		if(!vectors.empty())
+		{
+			vectors.front().iov_base = static_cast<char*>(vectors.front().iov_base) + count;
+			vectors.front().iov_len -= count;
+		}
+	}
+	else
+	{
+		for(; !vectors.empty() && count >= vectors.front().len; vectors = vectors.subspan(1))
+			count -= vectors.front().len;
+
+		if(!vectors.empty())
+		{
+			vectors.front().buf += count;
+			vectors.front().len -= static_cast<decltype(vectors.front().len)>(count);
+		}
+	}
+}
+
+} // namespace lsp::io
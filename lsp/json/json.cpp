@@ -1,12 +1,45 @@
 #include <algorithm>
+#include <atomic>
+#include <bit>
 #include <cassert>
 #include <charconv>
+#include <cmath>
+#include <cstring>
 #include <iterator>
 #include <limits>
+#include <mutex>
+#include <span>
 #include <string>
+#include <type_traits>
+#include <utility>
 #include <vector>
 #include <lsp/json/json.h>
 
+/*
+ * Set LSP_JSON_SIMD to 0 to only use the portable scalar implementation for scanning json text
+ */
+#ifndef LSP_JSON_SIMD
+	#define LSP_JSON_SIMD 1
+#endif
+
+#if LSP_JSON_SIMD
+	#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+		#define LSP_JSON_SSE2 1
+		#include <immintrin.h>
+		#if defined(__GNUC__) || defined(__clang__)
+			#define LSP_JSON_AVX2 1
+			#define LSP_JSON_TARGET_AVX2 __attribute__((target("avx2")))
+		#elif defined(_MSC_VER)
+			#define LSP_JSON_AVX2 1
+			#define LSP_JSON_TARGET_AVX2
+			#include <intrin.h>
+		#endif
+	#elif defined(__aarch64__) || defined(_M_ARM64)
+		#define LSP_JSON_NEON 1
+		#include <arm_neon.h>
+	#endif
+#endif
+
 namespace lsp::json{
 namespace{
 
@@ -15,449 +48,677 @@ constexpr std::string_view TrueValueString{"true"};
 constexpr std::string_view FalseValueString{"false"};
 
 /*
- * Parser
+ * Block classification
+ * Finds the positions of characters that are relevant for the json structure in blocks of 64 bytes.
+ * Bit n of each mask corresponds to byte n of the block.
  */
 
-class Parser{
-public:
-	Parser(std::string_view text) :
-		m_start{text.data()},
-		m_end{text.data() + text.size()},
-		m_pos{m_start}
-	{
-		m_stateStack.reserve(10);
-	}
-
-	bool atEnd() const
-	{
-		return m_pos >= m_end;
-	}
+constexpr std::size_t BlockSize = 64;
 
-	std::size_t textOffset(const char* pos) const
-	{
-		return static_cast<std::size_t>(std::distance(m_start, pos));
-	}
+struct BlockMasks{
+	std::uint64_t quote      = 0;
+	std::uint64_t backslash  = 0;
+	std::uint64_t op         = 0; // {}[]:,
+	std::uint64_t whitespace = 0;
+	std::uint64_t newline    = 0;
+};
 
-	std::size_t currentTextOffset() const
-	{
-		return textOffset(m_pos);
-	}
+using ClassifyBlocksFunc = void(*)(const char* data, std::size_t blockCount, BlockMasks* masks);
 
-	Any parse()
+[[maybe_unused]] void classifyBlocksScalar(const char* data, std::size_t blockCount, BlockMasks* masks)
+{
+	for(std::size_t block = 0; block < blockCount; ++block, data += BlockSize)
 	{
-		Any result;
+		auto& m = masks[block];
+		m = {};
 
-		pushState(State::Value, result);
-
-		while(!m_stateStack.empty())
+		for(std::size_t i = 0; i < BlockSize; ++i)
 		{
-			skipWhitespace();
-
-			if(atEnd())
-				throw ParseError{"Unexpected end of input", currentTextOffset()};
+			const auto bit = std::uint64_t{1} << i;
 
-			switch(currentState())
+			switch(data[i])
 			{
-			case State::Value:
-				handleValue();
+			case '\"':
+				m.quote |= bit;
 				break;
-			case State::Object:
-				handleObject();
+			case '\\':
+				m.backslash |= bit;
 				break;
-			case State::ObjectKey:
-				handleObjectKey();
+			case '{':
+			case '}':
+			case '[':
+			case ']':
+			case ':':
+			case ',':
+				m.op |= bit;
 				break;
-			case State::Array:
-				handleArray();
+			case '\n':
+				m.newline |= bit;
+				m.whitespace |= bit;
+				break;
+			case ' ':
+			case '\t':
+			case '\r':
+				m.whitespace |= bit;
+				break;
+			default:
 				break;
 			}
 		}
+	}
+}
 
-		skipWhitespace();
+#ifdef LSP_JSON_SSE2
+void classifyBlocksSse2(const char* data, std::size_t blockCount, BlockMasks* masks)
+{
+	const auto quote     = _mm_set1_epi8('\"');
+	const auto backslash = _mm_set1_epi8('\\');
+	const auto lowerBit  = _mm_set1_epi8(0x20);
+	const auto braceOpen = _mm_set1_epi8('{'); // '[' | 0x20 == '{'
+	const auto braceEnd  = _mm_set1_epi8('}'); // ']' | 0x20 == '}'
+	const auto colon     = _mm_set1_epi8(':');
+	const auto comma     = _mm_set1_epi8(',');
+	const auto space     = _mm_set1_epi8(' ');
+	const auto tab       = _mm_set1_epi8('\t');
+	const auto newline   = _mm_set1_epi8('\n');
+	const auto carriage  = _mm_set1_epi8('\r');
+
+	const auto toMask = [](__m128i v, int shift)
+	{
+		return static_cast<std::uint64_t>(static_cast<unsigned int>(_mm_movemask_epi8(v))) << shift;
+	};
 
-		if(!atEnd())
-			throw ParseError{"Trailing characters in json", currentTextOffset()};
+	for(std::size_t block = 0; block < blockCount; ++block, data += BlockSize)
+	{
+		auto& m = masks[block];
+		m = {};
 
-		return result;
+		for(int i = 0; i < 4; ++i)
+		{
+			const auto chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i * 16));
+			const auto lower = _mm_or_si128(chunk, lowerBit);
+			const auto nl    = _mm_cmpeq_epi8(chunk, newline);
+			const auto shift = i * 16;
+
+			m.quote      |= toMask(_mm_cmpeq_epi8(chunk, quote), shift);
+			m.backslash  |= toMask(_mm_cmpeq_epi8(chunk, backslash), shift);
+			m.op         |= toMask(_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(lower, braceOpen), _mm_cmpeq_epi8(lower, braceEnd)),
+			                                    _mm_or_si128(_mm_cmpeq_epi8(chunk, colon), _mm_cmpeq_epi8(chunk, comma))), shift);
+			m.whitespace |= toMask(_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, space), _mm_cmpeq_epi8(chunk, tab)),
+			                                    _mm_or_si128(nl, _mm_cmpeq_epi8(chunk, carriage))), shift);
+			m.newline    |= toMask(nl, shift);
+		}
 	}
+}
+#endif
 
-	void reset()
+#ifdef LSP_JSON_AVX2
+LSP_JSON_TARGET_AVX2
+void classifyBlocksAvx2(const char* data, std::size_t blockCount, BlockMasks* masks)
+{
+	const auto quote     = _mm256_set1_epi8('\"');
+	const auto backslash = _mm256_set1_epi8('\\');
+	const auto lowerBit  = _mm256_set1_epi8(0x20);
+	const auto braceOpen = _mm256_set1_epi8('{');
+	const auto braceEnd  = _mm256_set1_epi8('}');
+	const auto colon     = _mm256_set1_epi8(':');
+	const auto comma     = _mm256_set1_epi8(',');
+	const auto space     = _mm256_set1_epi8(' ');
+	const auto tab       = _mm256_set1_epi8('\t');
+	const auto newline   = _mm256_set1_epi8('\n');
+	const auto carriage  = _mm256_set1_epi8('\r');
+
+	for(std::size_t block = 0; block < blockCount; ++block, data += BlockSize)
 	{
-		m_stateStack.clear();
-		m_pos = m_start;
+		auto& m = masks[block];
+		m = {};
+
+		for(int i = 0; i < 2; ++i)
+		{
+			const auto chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i * 32));
+			const auto lower = _mm256_or_si256(chunk, lowerBit);
+			const auto nl    = _mm256_cmpeq_epi8(chunk, newline);
+			const auto shift = i * 32;
+
+			m.quote      |= static_cast<std::uint64_t>(static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, quote)))) << shift;
+			m.backslash  |= static_cast<std::uint64_t>(static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, backslash)))) << shift;
+			m.op         |= static_cast<std::uint64_t>(static_cast<std::uint32_t>(_mm256_movemask_epi8(
+			                  _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(lower, braceOpen), _mm256_cmpeq_epi8(lower, braceEnd)),
+			                                  _mm256_or_si256(_mm256_cmpeq_epi8(chunk, colon), _mm256_cmpeq_epi8(chunk, comma)))))) << shift;
+			m.whitespace |= static_cast<std::uint64_t>(static_cast<std::uint32_t>(_mm256_movemask_epi8(
+			                  _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(chunk, space), _mm256_cmpeq_epi8(chunk, tab)),
+			                                  _mm256_or_si256(nl, _mm256_cmpeq_epi8(chunk, carriage)))))) << shift;
+			m.newline    |= static_cast<std::uint64_t>(static_cast<std::uint32_t>(_mm256_movemask_epi8(nl))) << shift;
+		}
 	}
+}
 
-private:
-	enum class State{
-		Value,
-		Object,
-		ObjectKey,
-		Array
-	};
+bool cpuSupportsAvx2()
+{
+#if defined(__GNUC__) || defined(__clang__)
+	return __builtin_cpu_supports("avx2");
+#else
+	int info[4];
+	__cpuid(info, 0);
+
+	if(info[0] < 7)
+		return false;
+
+	// The OS also needs to save the ymm registers on context switches
+	__cpuid(info, 1);
+	const bool osxsave = (info[2] & (1 << 27)) != 0;
+	const bool avx     = (info[2] & (1 << 28)) != 0;
+
+	if(!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+		return false;
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#endif
+}
+#endif
 
-	struct StateStackEntry{
-		State context;
-		Any*    value;
+#ifdef LSP_JSON_NEON
+void classifyBlocksNeon(const char* data, std::size_t blockCount, BlockMasks* masks)
+{
+	const auto quote     = vdupq_n_u8('\"');
+	const auto backslash = vdupq_n_u8('\\');
+	const auto lowerBit  = vdupq_n_u8(0x20);
+	const auto braceOpen = vdupq_n_u8('{');
+	const auto braceEnd  = vdupq_n_u8('}');
+	const auto colon     = vdupq_n_u8(':');
+	const auto comma     = vdupq_n_u8(',');
+	const auto space     = vdupq_n_u8(' ');
+	const auto tab       = vdupq_n_u8('\t');
+	const auto newline   = vdupq_n_u8('\n');
+	const auto carriage  = vdupq_n_u8('\r');
+	static constexpr std::uint8_t BitWeights[16] = {0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80};
+	const auto bitWeights = vld1q_u8(BitWeights);
+
+	// Equivalent of _mm_movemask_epi8 for four 16 byte comparison results
+	const auto toMask = [&bitWeights](uint8x16_t r0, uint8x16_t r1, uint8x16_t r2, uint8x16_t r3)
+	{
+		auto sum0 = vpaddq_u8(vandq_u8(r0, bitWeights), vandq_u8(r1, bitWeights));
+		auto sum1 = vpaddq_u8(vandq_u8(r2, bitWeights), vandq_u8(r3, bitWeights));
+		sum0 = vpaddq_u8(sum0, sum1);
+		sum0 = vpaddq_u8(sum0, sum0);
+		return vgetq_lane_u64(vreinterpretq_u64_u8(sum0), 0);
 	};
 
-	std::vector<StateStackEntry> m_stateStack;
-	const char* const            m_start = nullptr;
-	const char* const            m_end   = nullptr;
-	const char*                  m_pos   = nullptr;
-
-	void handleValue()
+	for(std::size_t block = 0; block < blockCount; ++block, data += BlockSize)
 	{
-		assert(currentState() == State::Value);
+		const auto* bytes = reinterpret_cast<const std::uint8_t*>(data);
+		uint8x16_t chunk[4];
+		uint8x16_t lower[4];
+		uint8x16_t nl[4];
 
-		if(*m_pos == '{')
+		for(int i = 0; i < 4; ++i)
 		{
-			++m_pos;
-			currentValue() = Object{};
-			pushState(State::Object, currentValue());
+			chunk[i] = vld1q_u8(bytes + i * 16);
+			lower[i] = vorrq_u8(chunk[i], lowerBit);
+			nl[i]    = vceqq_u8(chunk[i], newline);
 		}
-		else if(*m_pos == '[')
+
+		const auto eq = [&chunk](int i, uint8x16_t c){ return vceqq_u8(chunk[i], c); };
+		const auto op = [&](int i)
 		{
-			++m_pos;
-			currentValue() = Array{};
-			pushState(State::Array, currentValue());
-		}
-		else
+			return vorrq_u8(vorrq_u8(vceqq_u8(lower[i], braceOpen), vceqq_u8(lower[i], braceEnd)),
+			                vorrq_u8(eq(i, colon), eq(i, comma)));
+		};
+		const auto ws = [&](int i)
 		{
-			currentValue() = parseSimpleValue();
-			popState();
-		}
+			return vorrq_u8(vorrq_u8(eq(i, space), eq(i, tab)), vorrq_u8(nl[i], eq(i, carriage)));
+		};
+
+		auto& m = masks[block];
+		m.quote      = toMask(eq(0, quote), eq(1, quote), eq(2, quote), eq(3, quote));
+		m.backslash  = toMask(eq(0, backslash), eq(1, backslash), eq(2, backslash), eq(3, backslash));
+		m.op         = toMask(op(0), op(1), op(2), op(3));
+		m.whitespace = toMask(ws(0), ws(1), ws(2), ws(3));
+		m.newline    = toMask(nl[0], nl[1], nl[2], nl[3]);
 	}
+}
+#endif
 
-	void handleObject()
-	{
-		assert(currentState() == State::Object);
-
-		if(*m_pos == '}')
-		{
-			++m_pos;
-			popState(); // Object
-			popState(); // Value
-		}
-		else
-		{
-			if(!currentValue().object().empty())
-			{
-				if(*m_pos != ',')
-					throw ParseError{"Expected ','", currentTextOffset()};
+ClassifyBlocksFunc selectClassifyBlocks()
+{
+#ifdef LSP_JSON_AVX2
+	if(cpuSupportsAvx2())
+		return classifyBlocksAvx2;
+#endif
+#ifdef LSP_JSON_SSE2
+	return classifyBlocksSse2;
+#elif defined(LSP_JSON_NEON)
+	return classifyBlocksNeon;
+#else
+	return classifyBlocksScalar;
+#endif
+}
 
-				const char* pos = m_pos;
-				++m_pos;
-				skipWhitespace();
+ClassifyBlocksFunc classifyBlocks()
+{
+	static const auto func = selectClassifyBlocks();
+	return func;
+}
 
-				if(!atEnd() && *m_pos == '}')
-					throw ParseError{"Trailing ','", textOffset(pos)};
-			}
+/*
+ * String escaping
+ * Finds the next character in a string that has to be escaped in a json string literal
+ * so the text in between can be copied in bulk.
+ */
 
-			pushState(State::ObjectKey, currentValue());
-		}
-	}
+using FindEscapeFunc = std::size_t(*)(const char* data, std::size_t size);
 
-	void handleObjectKey()
-	{
-		assert(currentState() == State::ObjectKey);
+bool needsEscape(char c)
+{
+	return static_cast<unsigned char>(c) < 0x20 || c == '\"' || c == '\\';
+}
 
-		const char* keyPos = m_pos;
-		auto&       object = currentValue().object();
-		const auto  key    = parseString();
+std::size_t findEscapeScalar(const char* data, std::size_t size)
+{
+	std::size_t i = 0;
 
-		if(object.contains(key))
-			throw ParseError{"Duplicate key '" + key + "'", textOffset(keyPos)};
+	while(i < size && !needsEscape(data[i]))
+		++i;
 
-		skipWhitespace();
+	return i;
+}
 
-		if(!atEnd() && *m_pos != ':')
-			throw ParseError{"Expected ':'", currentTextOffset()};
+#ifdef LSP_JSON_SSE2
+std::size_t findEscapeSse2(const char* data, std::size_t size)
+{
+	const auto quote      = _mm_set1_epi8('\"');
+	const auto backslash  = _mm_set1_epi8('\\');
+	const auto controlMax = _mm_set1_epi8(0x1F);
+	std::size_t i = 0;
 
-		++m_pos;
+	for(; i + 16 <= size; i += 16)
+	{
+		const auto chunk   = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+		const auto control = _mm_cmpeq_epi8(_mm_min_epu8(chunk, controlMax), chunk);
+		const auto escape  = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)), control);
 
-		popState();
-		pushState(State::Value, object[key]);
+		if(const auto mask = static_cast<unsigned int>(_mm_movemask_epi8(escape)); mask != 0)
+			return i + static_cast<std::size_t>(std::countr_zero(mask));
 	}
 
-	void handleArray()
+	return i + findEscapeScalar(data + i, size - i);
+}
+#endif
+
+#ifdef LSP_JSON_AVX2
+LSP_JSON_TARGET_AVX2
+std::size_t findEscapeAvx2(const char* data, std::size_t size)
+{
+	const auto quote      = _mm256_set1_epi8('\"');
+	const auto backslash  = _mm256_set1_epi8('\\');
+	const auto controlMax = _mm256_set1_epi8(0x1F);
+	std::size_t i = 0;
+
+	for(; i + 32 <= size; i += 32)
 	{
-		assert(currentState() == State::Array);
+		const auto chunk   = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+		const auto control = _mm256_cmpeq_epi8(_mm256_min_epu8(chunk, controlMax), chunk);
+		const auto escape  = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(chunk, quote), _mm256_cmpeq_epi8(chunk, backslash)), control);
 
-		if(*m_pos == ']')
-		{
-			++m_pos;
-			popState(); // Array
-			popState(); // Value
-		}
-		else
-		{
-			auto& array = currentValue().array();
+		if(const auto mask = static_cast<std::uint32_t>(_mm256_movemask_epi8(escape)); mask != 0)
+			return i + static_cast<std::size_t>(std::countr_zero(mask));
+	}
 
-			if(!array.empty())
-			{
-				if(*m_pos != ',')
-					throw ParseError{"Expected ','", currentTextOffset()};
+	return i + findEscapeSse2(data + i, size - i);
+}
+#endif
 
-				const char* pos = m_pos;
-				++m_pos;
-				skipWhitespace();
+#ifdef LSP_JSON_NEON
+std::size_t findEscapeNeon(const char* data, std::size_t size)
+{
+	const auto quote        = vdupq_n_u8('\"');
+	const auto backslash    = vdupq_n_u8('\\');
+	const auto controlLimit = vdupq_n_u8(0x20);
+	const auto* bytes = reinterpret_cast<const std::uint8_t*>(data);
+	std::size_t i = 0;
 
-				if(!atEnd() && *m_pos == ']')
-					throw ParseError{"Trailing ','", textOffset(pos)};
-			}
+	for(; i + 16 <= size; i += 16)
+	{
+		const auto chunk  = vld1q_u8(bytes + i);
+		const auto escape = vorrq_u8(vorrq_u8(vceqq_u8(chunk, quote), vceqq_u8(chunk, backslash)), vcltq_u8(chunk, controlLimit));
 
-			pushState(State::Value, array.emplace_back());
+		if(vmaxvq_u8(escape) != 0)
+		{
+			// Narrow each byte of the comparison result to 4 bits
+			const auto nibbles = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(escape), 4)), 0);
+			return i + static_cast<std::size_t>(std::countr_zero(nibbles) / 4);
 		}
 	}
 
-	State currentState() const
-	{
-		assert(!m_stateStack.empty());
-		return m_stateStack.back().context;
-	}
+	return i + findEscapeScalar(data + i, size - i);
+}
+#endif
 
-	Any& currentValue()
-	{
-		assert(!m_stateStack.empty());
-		return *m_stateStack.back().value;
-	}
+FindEscapeFunc selectFindEscape()
+{
+#ifdef LSP_JSON_AVX2
+	if(cpuSupportsAvx2())
+		return findEscapeAvx2;
+#endif
+#ifdef LSP_JSON_SSE2
+	return findEscapeSse2;
+#elif defined(LSP_JSON_NEON)
+	return findEscapeNeon;
+#else
+	return findEscapeScalar;
+#endif
+}
 
-	void pushState(State state, Any& value)
-	{
-		m_stateStack.push_back({state, &value});
-	}
+FindEscapeFunc findEscape()
+{
+	static const auto func = selectFindEscape();
+	return func;
+}
 
-	void popState()
-	{
-		assert(!m_stateStack.empty());
-		m_stateStack.pop_back();
-	}
+/*
+ * StructuralIndexer
+ * Computes the offsets of all tokens in the text from the block masks:
+ * Operators and literals outside of strings as well as the opening and closing quotes of every string.
+ * Raw newlines inside of strings are also reported so the parser can reject them.
+ * State is carried over between blocks so the text can be indexed in multiple steps.
+ */
 
-	void skipWhitespace()
-	{
-		while(!atEnd() && std::isspace(static_cast<unsigned char>(*m_pos)))
-			++m_pos;
-	}
+class StructuralIndexer{
+public:
+	using Index = std::uint32_t;
 
-	String parseString()
+	void index(const char* data, std::size_t size, std::size_t offset, std::vector<Index>& indices)
 	{
-		if(atEnd() || *m_pos != '\"')
-			throw ParseError{"String expected", currentTextOffset()};
+		constexpr std::size_t BatchSize = 16;
+		BlockMasks masks[BatchSize];
 
-		const char* stringStart = m_pos++;
+		const auto classify   = classifyBlocks();
+		const auto blockCount = size / BlockSize;
 
-		bool escaping = false;
-		while(*m_pos != '\"' || escaping)
+		for(std::size_t block = 0; block < blockCount;)
 		{
-			if(!escaping && *m_pos == '\\')
-				escaping = true;
-			else // Already escaping or no '\'
-				escaping = false;
+			const auto count = std::min(BatchSize, blockCount - block);
+			classify(data + block * BlockSize, count, masks);
 
-			++m_pos;
+			for(std::size_t i = 0; i < count; ++i, ++block)
+				processBlock(masks[i], offset + block * BlockSize, indices);
+		}
 
-			if(atEnd() || *m_pos == '\n')
-				throw ParseError{"Unmatched '\"'", currentTextOffset()};
+		if(const auto remaining = size % BlockSize; remaining != 0)
+		{
+			char padded[BlockSize];
+			std::memset(padded, ' ', BlockSize);
+			std::memcpy(padded, data + blockCount * BlockSize, remaining);
+			classify(padded, 1, masks);
+			processBlock(masks[0], offset + blockCount * BlockSize, indices);
 		}
+	}
 
-		const char* stringEnd = ++m_pos;
+private:
+	std::uint64_t m_prevEscaped = 0; // 1 if the first character of the next block is escaped
+	std::uint64_t m_prevInString = 0; // All bits set if the previous block ended inside of a string
+	std::uint64_t m_prevScalar = 0; // 1 if the previous block ended with a literal
 
-		return fromStringLiteral(std::string_view{stringStart, stringEnd});
+	static std::uint64_t prefixXor(std::uint64_t bits)
+	{
+		bits ^= bits << 1;
+		bits ^= bits << 2;
+		bits ^= bits << 4;
+		bits ^= bits << 8;
+		bits ^= bits << 16;
+		bits ^= bits << 32;
+		return bits;
 	}
 
-	Any parseNumber()
+	// Returns the characters that are escaped by an odd number of preceding backslashes
+	std::uint64_t findEscaped(std::uint64_t backslash)
 	{
-		const char* numberStart = m_pos;
-		bool isDecimal = false;
-
-		while(!atEnd() && (
-		      std::isalnum(static_cast<unsigned char>(*m_pos)) ||
-		      *m_pos == '-' ||
-		      *m_pos == '.' ||
-		      *m_pos == 'e' ||
-		      *m_pos == 'E')
-		)
-		{
-			if(!isDecimal && (*m_pos == '.' || *m_pos == 'e' || *m_pos == 'E'))
-				isDecimal = true;
-
-			++m_pos;
-		}
-
-		if(isDecimal)
+		if(backslash == 0)
 		{
-			std::size_t   idx     = 0;
-			const Decimal decimal = std::stod(std::string{numberStart, m_pos}, &idx);
-
-			if(idx < static_cast<std::size_t>(std::distance(numberStart, m_pos)))
-				throw ParseError{"Invalid number value: '" + std::string{numberStart, m_pos} + "'", textOffset(numberStart)};
-
-			return decimal;
+			const auto escaped = m_prevEscaped;
+			m_prevEscaped = 0;
+			return escaped;
 		}
 
-		std::int64_t intValue;
-		const auto [ptr, ec] = std::from_chars(numberStart, m_pos, intValue);
-
-		if(ec != std::errc{} || ptr != m_pos)
-			throw ParseError{"Invalid number value: '" + std::string{numberStart, m_pos} + "'", textOffset(numberStart)};
+		constexpr std::uint64_t EvenBits = 0x5555555555555555ULL;
 
-		if(intValue < std::numeric_limits<json::Integer>::min() || intValue > std::numeric_limits<json::Integer>::max())
-			return static_cast<json::Decimal>(intValue);
+		backslash &= ~m_prevEscaped;
+		const auto followsEscape     = (backslash << 1) | m_prevEscaped;
+		const auto oddSequenceStarts = backslash & ~EvenBits & ~followsEscape;
+		const auto sequencesStartingOnEvenBits = oddSequenceStarts + backslash;
+		m_prevEscaped = sequencesStartingOnEvenBits < oddSequenceStarts ? 1 : 0;
+		const auto invertMask = sequencesStartingOnEvenBits << 1;
 
-		return static_cast<json::Integer>(intValue);
+		return (EvenBits ^ invertMask) & followsEscape;
 	}
 
-	Any parseIdentifier()
+	void processBlock(const BlockMasks& masks, std::size_t offset, std::vector<Index>& indices)
 	{
-		const char* idStart = m_pos;
-
-		while(!atEnd() && std::isalnum(static_cast<unsigned char>(*m_pos)))
-			++m_pos;
+		const auto escaped  = findEscaped(masks.backslash);
+		const auto quote    = masks.quote & ~escaped;
+		const auto inString = prefixXor(quote) ^ m_prevInString;
+		m_prevInString = static_cast<std::uint64_t>(static_cast<std::int64_t>(inString) >> 63);
 
-		auto identifier = std::string_view(idStart, m_pos);
+		const auto scalar                = ~(masks.op | masks.whitespace);
+		const auto nonQuoteScalar        = scalar & ~quote;
+		const auto followsNonQuoteScalar = (nonQuoteScalar << 1) | m_prevScalar;
+		m_prevScalar = nonQuoteScalar >> 63;
+		const auto scalarStart = scalar & ~followsNonQuoteScalar;
 
-		if(identifier == TrueValueString)
-			return Boolean(true);
+		auto structurals = ((masks.op | scalarStart) & ~inString) | quote | (masks.newline & inString);
 
-		if(identifier == FalseValueString)
-			return Boolean(false);
+		if(structurals == 0)
+			return;
 
-		if(identifier == NullValueString)
-			return Null();
+		auto pos = indices.size();
+		indices.resize(pos + static_cast<std::size_t>(std::popcount(structurals)));
 
-		throw ParseError{"Unexpected '" + std::string(identifier) + "'", currentTextOffset()};
+		while(structurals != 0)
+		{
+			indices[pos++] = static_cast<Index>(offset + static_cast<std::size_t>(std::countr_zero(structurals)));
+			structurals &= structurals - 1;
+		}
 	}
+};
 
-	Any parseSimpleValue()
-	{
-		if(*m_pos == '\"')
-			return parseString();
+/*
+ * Number codec
+ * Numbers are converted directly from and to the json text without going through std::string or the C locale.
+ * Integers that fit into json::Integer take a path that only accumulates digits.
+ */
 
-		if(std::isdigit(static_cast<unsigned char>(*m_pos)) || *m_pos == '-')
-			return parseNumber();
+// Enough for the shortest representation of any double or 64 bit integer
+constexpr std::size_t MaxNumberLength = 32;
 
-		if(std::isalpha(static_cast<unsigned char>(*m_pos)))
-			return parseIdentifier();
+// The largest number of decimal digits that always fits into a 64 bit integer
+constexpr std::ptrdiff_t MaxExactIntegerDigits = 18;
 
-		throw ParseError{"Unexpected token", currentTextOffset()};
-	}
-};
+bool isDigit(char c)
+{
+	return static_cast<unsigned char>(c - '0') < 10;
+}
 
-void stringifyImplementation(const Any& json, std::string& str, std::size_t indentLevel, bool format)
+const char* skipDigits(const char* it, const char* end)
 {
-	const auto getIndent = [&indentLevel, format]()
-	{
-		if(!format)
-			return std::string_view{};
+	while(it != end && isDigit(*it))
+		++it;
 
-		static constexpr std::string_view Tabs{"\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t"};
-		return Tabs.substr(0, std::min(indentLevel, Tabs.size()));
-	};
+	return it;
+}
 
-	std::string_view keySep{":"};
-	std::string_view valueSep{","};
-	std::string_view listStart;
-	std::string_view listEnd;
+// Parses a number with the json number grammar. Returns false if the text is not a valid json number.
+bool parseNumberLiteral(std::string_view text, Any& result)
+{
+	const auto* const begin = text.data();
+	const auto* const end   = begin + text.size();
+	const auto*       it    = begin;
+	const bool        isNegative = it != end && *it == '-';
 
-	if(format)
-	{
-		keySep = ": ";
-		valueSep = ",\n";
-		listStart = "\n";
-		listEnd = "\n";
-	}
+	if(isNegative)
+		++it;
 
-	if(json.isNull())
+	const auto*   integerStart = it;
+	std::uint64_t integer      = 0;
+
+	while(it != end && isDigit(*it))
 	{
-		str += NullValueString;
+		integer = integer * 10 + static_cast<std::uint64_t>(*it - '0');
+		++it;
 	}
-	else if(json.isBoolean())
+
+	const auto integerDigits = it - integerStart;
+
+	if(integerDigits == 0 || (*integerStart == '0' && integerDigits > 1))
+		return false;
+
+	if(it == end && integerDigits <= MaxExactIntegerDigits)
 	{
-		str += json.boolean() ? TrueValueString : FalseValueString;
+		const auto value = isNegative ? -static_cast<std::int64_t>(integer) : static_cast<std::int64_t>(integer);
+
+		if(value >= std::numeric_limits<Integer>::min() && value <= std::numeric_limits<Integer>::max())
+			result = static_cast<Integer>(value);
+		else
+			result = static_cast<Decimal>(value);
+
+		return true;
 	}
-	else if(json.isInteger())
+
+	if(it != end && *it == '.')
 	{
-		str += std::to_string(json.integer());
+		const auto* fractionStart = ++it;
+		it = skipDigits(it, end);
+
+		if(it == fractionStart)
+			return false;
 	}
-	else if(json.isDecimal())
+
+	if(it != end && (*it == 'e' || *it == 'E'))
 	{
-		auto numberStr = std::to_string(json.decimal());
+		++it;
 
-		for(std::size_t i = numberStr.size(); i > 2; --i)
-		{
-			if(numberStr[i] != '0' || numberStr[i - 1] == '.')
-				break;
+		if(it != end && (*it == '+' || *it == '-'))
+			++it;
 
-			numberStr.pop_back();
-		}
+		const auto* exponentStart = it;
+		it = skipDigits(it, end);
 
-		str += numberStr;
-	}
-	else if(json.isString())
-	{
-		str += toStringLiteral(json.string());
+		if(it == exponentStart)
+			return false;
 	}
-	else if(json.isObject())
-	{
-		const auto& obj = json.object();
 
-		str += '{';
+	if(it != end)
+		return false;
 
-		if(auto it = obj.begin(); it != obj.end())
+	Decimal decimal;
+	const auto [ptr, ec] = std::from_chars(begin, end, decimal);
+
+	if(ec != std::errc{} || ptr != end)
+		return false;
+
+	result = decimal;
+
+	return true;
+}
+
+void appendInteger(std::string& str, Integer integer)
+{
+	char buffer[MaxNumberLength];
+	const auto [end, ec] = std::to_chars(buffer, buffer + sizeof(buffer), integer);
+	assert(ec == std::errc{});
+	str.append(buffer, end);
+}
+
+// Writes the shortest text that is parsed back to the same value
+void appendDecimal(std::string& str, Decimal decimal);
+
+/*
+ * Writes comma separated integers. The text is built in chunks on the stack so
+ * the string only grows once per chunk instead of once per value.
+ * Unsigned values that do not fit into an Integer are written as decimals like
+ * any other number outside of the Integer range.
+ */
+template<typename T>
+void appendIntegers(std::string& str, std::span<const T> values)
+{
+	static constexpr std::size_t ChunkSize = 256;
+	static constexpr std::size_t MaxIntegerLength = 11; // Sign and 10 digits
+
+	char buffer[ChunkSize * (MaxIntegerLength + 1)];
+	auto it = values.begin();
+
+	while(it != values.end())
+	{
+		const auto chunkEnd = it + static_cast<std::ptrdiff_t>(std::min<std::size_t>(ChunkSize, static_cast<std::size_t>(values.end() - it)));
+		char* out = buffer;
+
+		for(; it != chunkEnd; ++it)
 		{
-			str += listStart;
-			++indentLevel;
-			str += getIndent();
-			str += toStringLiteral(it->first);
-			str += keySep;
-			stringifyImplementation(it->second, str, indentLevel, format);
-			++it;
+			if(it != values.begin())
+				*out++ = ',';
 
-			while(it != obj.end())
+			if constexpr(std::is_unsigned_v<T>)
 			{
-				str += valueSep;
-				str += getIndent();
-				str += toStringLiteral(it->first);
-				str += keySep;
-				stringifyImplementation(it->second, str, indentLevel, format);
-				++it;
+				if(*it > static_cast<T>(std::numeric_limits<Integer>::max()))
+				{
+					str.append(buffer, out);
+					appendDecimal(str, static_cast<Decimal>(*it));
+					out = buffer;
+					continue;
+				}
 			}
 
-			str += listEnd;
-			--indentLevel;
-			str += getIndent();
+			out = std::to_chars(out, out + MaxIntegerLength, *it).ptr;
 		}
 
-		str += '}';
+		str.append(buffer, out);
 	}
-	else if(json.isArray())
+}
+
+void appendDecimal(std::string& str, Decimal decimal)
+{
+	// Json has no representation for infinity and NaN
+	if(!std::isfinite(decimal))
 	{
-		const auto& array = json.array();
+		str += NullValueString;
+		return;
+	}
 
-		str += '[';
+	char buffer[MaxNumberLength];
+	const auto [end, ec] = std::to_chars(buffer, buffer + sizeof(buffer), decimal);
+	assert(ec == std::errc{});
+	const std::string_view number{buffer, static_cast<std::size_t>(end - buffer)};
 
-		if(auto it = array.begin(); it != array.end())
-		{
-			str += listStart;
-			++indentLevel;
-			str += getIndent();
-			stringifyImplementation(*it, str, indentLevel, format);
-			++it;
+	str += number;
 
-			while(it != array.end())
-			{
-				str += valueSep;
-				str += getIndent();
-				stringifyImplementation(*it, str, indentLevel, format);
-				++it;
-			}
+	// Make sure the number is read back as a decimal and not as an integer
+	if(number.find_first_of(".e") == std::string_view::npos)
+		str += ".0";
+}
 
-			str += listEnd;
-			--indentLevel;
-			str += getIndent();
-		}
+bool isNumberStart(char c)
+{
+	return (c >= '0' && c <= '9') || c == '-';
+}
 
-		str += ']';
+bool isTokenDelimiter(char c)
+{
+	switch(c)
+	{
+	case '{':
+	case '}':
+	case '[':
+	case ']':
+	case ':':
+	case ',':
+	case '\"':
+	case ' ':
+	case '\t':
+	case '\n':
+	case '\r':
+		return true;
+	default:
+		return false;
 	}
 }
 
@@ -491,171 +752,2536 @@ void appendCodePointAsUtf8(std::string& str, unsigned int codepoint)
 	}
 }
 
-} // namespace
-
-Any& Object::get(std::string_view key)
-{
-	if(const auto it = find(key); it != end())
-		return it->second;
-
-	throw TypeError{"Missing key '" + std::string{key} + '\''};
-}
-
-const Any& Object::get(std::string_view key) const
+/*
+ * Appends the unescaped content of a string literal without the surrounding quotes to str.
+ * Text between escape sequences is copied in bulk.
+ * The non-standard escape sequences \0, \a and \v that older versions wrote are still accepted.
+ */
+void appendUnescaped(std::string& str, std::string_view literal)
 {
-	if(const auto it = find(key); it != end())
-		return it->second;
+	str.reserve(str.size() + literal.size());
 
-	throw TypeError{"Missing key '" + std::string{key} + '\''};
-}
+	while(!literal.empty())
+	{
+		const auto* escape = static_cast<const char*>(std::memchr(literal.data(), '\\', literal.size()));
 
-Any parse(std::string_view text)
-{
-	Parser parser{text};
+		if(!escape)
+		{
+			str += literal;
+			break;
+		}
 
-	return parser.parse();
-}
+		str.append(literal.data(), static_cast<std::size_t>(escape - literal.data()));
+		literal.remove_prefix(static_cast<std::size_t>(escape - literal.data()) + 1);
 
-std::string stringify(const Any& json, bool format)
-{
-	std::string str;
-	stringifyImplementation(json, str, 0, format);
-	return str;
-}
+		if(literal.empty())
+		{
+			str += '\\';
+			break;
+		}
 
-std::string toStringLiteral(std::string_view str)
-{
-	std::string result;
-	result.reserve(str.size() + 2);
-	result += '\"';
+		const char c = literal.front();
+		literal.remove_prefix(1);
 
-	for(const char c : str)
-	{
 		switch(c)
 		{
-		case '\0':
-			result += "\\0";
-			break;
-		case '\a':
-			result += "\\a";
-			break;
-		case '\b':
-			result += "\\b";
+		case '0':
+			str += '\0';
 			break;
-		case '\t':
-			result += "\\t";
+		case 'a':
+			str += '\a';
 			break;
-		case '\n':
-			result += "\\n";
+		case 'b':
+			str += '\b';
 			break;
-		case '\v':
-			result += "\\v";
+		case 't':
+			str += '\t';
 			break;
-		case '\f':
-			result += "\\f";
+		case 'n':
+			str += '\n';
 			break;
-		case '\r':
-			result += "\\r";
+		case 'v':
+			str += '\v';
 			break;
-		case '\"':
-			result += "\\\"";
+		case 'f':
+			str += '\f';
 			break;
-		case '\\':
-			result += "\\\\";
+		case 'r':
+			str += '\r';
 			break;
+		case 'u':
+			{
+				const auto* first = literal.data();
+				const auto* last  = first + std::min<std::size_t>(literal.size(), 4);
+				unsigned int codepoint = 0;
+				const auto [ptr, ec] = std::from_chars(first, last, codepoint, 16);
+
+				if(last - first == 4 && ec == std::errc{} && ptr == last)
+				{
+					appendCodePointAsUtf8(str, codepoint);
+					literal.remove_prefix(4);
+				}
+				else
+				{
+					// Invalid escape sequences are kept as they are
+					const auto len = static_cast<std::size_t>((last - first == 4 ? ptr : last) - first);
+					str += "\\u";
+					str.append(first, len);
+					literal.remove_prefix(len);
+				}
+				break;
+			}
 		default:
-			result += c;
+			str += c;
 		}
 	}
+}
+
+/*
+ * Tokenizer
+ * Walks the token offsets found by the StructuralIndexer and parses the simple values.
+ * The text is indexed in windows on demand so the memory used for the offsets does not grow with the text.
+ */
+
+class Tokenizer{
+public:
+	Tokenizer(std::string_view text)
+		: m_text{text}
+	{
+		if(m_text.size() > std::numeric_limits<StructuralIndexer::Index>::max())
+			throw ParseError{"Json text is too large", 0};
+	}
 
-	result += '\"';
+protected:
+	const std::string_view m_text;
 
-	return result;
-}
+	bool atEnd()
+	{
+		return m_next >= m_indices.size() && !indexNextWindow();
+	}
 
-std::string fromStringLiteral(std::string_view str)
-{
-	if(str.size() > 0 && str.front() == '\"')
-		str.remove_prefix(1);
+	std::size_t currentTextOffset() const
+	{
+		assert(m_next < m_indices.size());
+		return m_indices[m_next];
+	}
 
-	if(str.size() > 0 && str.back() == '\"')
-		str.remove_suffix(1);
+	char currentChar() const
+	{
+		return m_text[currentTextOffset()];
+	}
 
-	std::string result;
-	result.reserve(str.size());
+	void advance()
+	{
+		++m_next;
+	}
+
+	// Returns the text of the literal starting at the current token
+	std::string_view nextLiteral()
+	{
+		const auto start = currentTextOffset();
+		auto       end   = start + 1;
+
+		while(end < m_text.size() && !isTokenDelimiter(m_text[end]))
+			++end;
+
+		advance();
+
+		return m_text.substr(start, end - start);
+	}
+
+	// Returns the text offset following the closing quote
+	std::size_t parseString(String& result)
+	{
+		if(atEnd() || currentChar() != '\"')
+			throw ParseError{"String expected", atEnd() ? m_text.size() : currentTextOffset()};
+
+		const auto stringStart = currentTextOffset();
+		advance();
+
+		// The next token is either the closing quote or a newline inside of the string
+		if(atEnd() || currentChar() != '\"')
+			throw ParseError{"Unmatched '\"'", atEnd() ? m_text.size() : currentTextOffset()};
+
+		const auto stringEnd = currentTextOffset() + 1;
+		advance();
+
+		result.clear();
+		appendUnescaped(result, m_text.substr(stringStart + 1, stringEnd - stringStart - 2));
+
+		return stringEnd;
+	}
+
+	String parseString()
+	{
+		String result;
+		parseString(result);
+
+		return result;
+	}
+
+	Any parseNumber()
+	{
+		const auto numberStart = currentTextOffset();
+		const auto number      = nextLiteral();
+		Any        result;
+
+		if(!parseNumberLiteral(number, result))
+			throw ParseError{"Invalid number value: '" + std::string{number} + "'", numberStart};
+
+		return result;
+	}
+
+	Any parseIdentifier()
+	{
+		const auto identifierStart = currentTextOffset();
+		const auto identifier      = nextLiteral();
+
+		if(identifier == TrueValueString)
+			return Boolean(true);
+
+		if(identifier == FalseValueString)
+			return Boolean(false);
+
+		if(identifier == NullValueString)
+			return Null();
+
+		throw ParseError{"Unexpected '" + std::string(identifier) + "'", identifierStart};
+	}
+
+	Any parseSimpleValue()
+	{
+		const auto c = currentChar();
+
+		if(c == '\"')
+			return parseString();
+
+		if(isNumberStart(c))
+			return parseNumber();
+
+		if((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'))
+			return parseIdentifier();
+
+		throw ParseError{"Unexpected token", currentTextOffset()};
+	}
+
+private:
+	static constexpr std::size_t WindowSize = 256 * BlockSize;
+
+	StructuralIndexer                     m_indexer;
+	std::vector<StructuralIndexer::Index> m_indices;
+	std::size_t                           m_next    = 0;
+	std::size_t                           m_indexed = 0;
+
+	bool indexNextWindow()
+	{
+		while(m_indexed < m_text.size())
+		{
+			const auto size = std::min(WindowSize, m_text.size() - m_indexed);
+
+			m_indices.clear();
+			m_next = 0;
+			m_indexer.index(m_text.data() + m_indexed, size, m_indexed, m_indices);
+			m_indexed += size;
+
+			if(!m_indices.empty())
+				return true;
+		}
+
+		return false;
+	}
+};
+
+/*
+ * Parser
+ * Builds the json value from the tokens
+ */
+
+class Parser : private Tokenizer{
+public:
+	Parser(std::string_view text, const Allocator& allocator = {})
+		: Tokenizer{text}
+		, m_allocator{allocator}
+	{
+		m_stateStack.reserve(10);
+	}
 
-	for(std::size_t i = 0; i < str.size(); ++i)
+	Any parse()
 	{
-		if(str[i] == '\\' && i != str.size() - 1)
+		Any result;
+
+		pushState(State::Value, result);
+
+		while(!m_stateStack.empty())
 		{
-			++i;
-			switch(str[i])
+			if(atEnd())
+				throw ParseError{"Unexpected end of input", m_text.size()};
+
+			switch(currentState())
 			{
-			case '0':
-				result += '\0';
-				break;
-			case 'a':
-				result += '\a';
-				break;
-			case 'b':
-				result += '\b';
-				break;
-			case 't':
-				result += '\t';
-				break;
-			case 'n':
-				result += '\n';
+			case State::Value:
+				handleValue();
 				break;
-			case 'v':
-				result += '\v';
+			case State::Object:
+				handleObject();
 				break;
-			case 'f':
-				result += '\f';
+			case State::ObjectKey:
+				handleObjectKey();
 				break;
-			case 'r':
-				result += '\r';
+			case State::Array:
+				handleArray();
 				break;
-			case 'u':
-				{
-					const auto* first = str.data() + i + 1;
-					const auto* last  = first + 4;
-
-					if(last <= str.data() + str.size())
-					{
-						unsigned int codepoint;
-						const auto [ptr, ec] = std::from_chars(first, last, codepoint, 16);
-
-						if(ec == std::errc{} && ptr == last)
-						{
-							appendCodePointAsUtf8(result, codepoint);
-							i += 4;
-						}
-						else
-						{
-							const auto len = static_cast<std::size_t>(std::distance(first, ptr));
-							result += "\\u";
-							result += std::string_view(first, len);
-							i += len;
-						}
-					}
-					else
-					{
-						const auto len = static_cast<std::size_t>(std::distance(first, str.data() + str.size()));
-						result += "\\u";
-						result += std::string_view(first, len);
-						i += len;
-					}
-					break;
-				}
-			default:
-				result += str[i];
 			}
 		}
-		else
-		{
-			result += str[i];
-		}
-	}
+
+		if(!atEnd())
+			throw ParseError{"Trailing characters in json", currentTextOffset()};
+
+		return result;
+	}
+
+private:
+	enum class State{
+		Value,
+		Object,
+		ObjectKey,
+		Array
+	};
+
+	struct StateStackEntry{
+		State context;
+		Any*    value;
+	};
+
+	std::vector<StateStackEntry> m_stateStack;
+	const Allocator              m_allocator;
+
+	void handleValue()
+	{
+		assert(currentState() == State::Value);
+
+		if(currentChar() == '{')
+		{
+			advance();
+			currentValue() = Object{m_allocator};
+			pushState(State::Object, currentValue());
+		}
+		else if(currentChar() == '[')
+		{
+			advance();
+
+			// Arrays starting with a number are likely to only contain integers
+			if(!atEnd() && isNumberStart(currentChar()))
+				currentValue() = IntegerArray{m_allocator};
+			else
+				currentValue() = Array{m_allocator};
+
+			pushState(State::Array, currentValue());
+		}
+		else if(currentChar() == '"')
+		{
+			currentValue() = Any{std::allocator_arg, m_allocator, parseString()};
+			popState();
+		}
+		else
+		{
+			currentValue() = parseSimpleValue();
+			popState();
+		}
+	}
+
+	void handleObject()
+	{
+		assert(currentState() == State::Object);
+
+		if(currentChar() == '}')
+		{
+			advance();
+			popState(); // Object
+			popState(); // Value
+		}
+		else
+		{
+			if(!currentValue().object().empty())
+			{
+				if(currentChar() != ',')
+					throw ParseError{"Expected ','", currentTextOffset()};
+
+				const auto pos = currentTextOffset();
+				advance();
+
+				if(!atEnd() && currentChar() == '}')
+					throw ParseError{"Trailing ','", pos};
+			}
+
+			pushState(State::ObjectKey, currentValue());
+		}
+	}
+
+	void handleObjectKey()
+	{
+		assert(currentState() == State::ObjectKey);
+
+		const auto keyPos         = currentTextOffset();
+		auto&      object         = currentValue().object();
+		auto       [it, inserted] = object.try_emplace(Key::plain(parseString()));
+
+		if(!inserted)
+			throw ParseError{"Duplicate key '" + it->first.str() + "'", keyPos};
+
+		if(atEnd() || currentChar() != ':')
+			throw ParseError{"Expected ':'", atEnd() ? m_text.size() : currentTextOffset()};
+
+		advance();
+
+		popState();
+		pushState(State::Value, it->second);
+	}
+
+	void handleArray()
+	{
+		assert(currentState() == State::Array);
+
+		if(currentChar() == ']')
+		{
+			advance();
+			popState(); // Array
+			popState(); // Value
+		}
+		else
+		{
+			auto&      value = currentValue();
+			const bool empty = value.isIntegerArray() ? std::as_const(value).integerArray().empty() : value.array().empty();
+
+			if(!empty)
+			{
+				if(currentChar() != ',')
+					throw ParseError{"Expected ','", currentTextOffset()};
+
+				const auto pos = currentTextOffset();
+				advance();
+
+				if(!atEnd() && currentChar() == ']')
+					throw ParseError{"Trailing ','", pos};
+			}
+
+			if(value.isIntegerArray() && !atEnd() && isNumberStart(currentChar()))
+				handleIntegers(value);
+			else
+				pushState(State::Value, value.array().emplace_back());
+		}
+	}
+
+	// Reads integers into a packed array without going through the state stack for each of them
+	void handleIntegers(Any& value)
+	{
+		auto& integers = value.integerArray();
+
+		while(true)
+		{
+			auto number = parseNumber();
+
+			if(!number.isInteger())
+			{
+				value.array().push_back(std::move(number)); // Stops packing the array
+				return;
+			}
+
+			integers.push_back(number.integer());
+
+			if(atEnd() || currentChar() != ',')
+				return;
+
+			const auto pos = currentTextOffset();
+			advance();
+
+			if(!atEnd() && currentChar() == ']')
+				throw ParseError{"Trailing ','", pos};
+
+			if(atEnd() || !isNumberStart(currentChar()))
+			{
+				pushState(State::Value, value.array().emplace_back());
+				return;
+			}
+		}
+	}
+
+	State currentState() const
+	{
+		assert(!m_stateStack.empty());
+		return m_stateStack.back().context;
+	}
+
+	Any& currentValue()
+	{
+		assert(!m_stateStack.empty());
+		return *m_stateStack.back().value;
+	}
+
+	void pushState(State state, Any& value)
+	{
+		m_stateStack.push_back({state, &value});
+	}
+
+	void popState()
+	{
+		assert(!m_stateStack.empty());
+		m_stateStack.pop_back();
+	}
+};
+
+void appendStringLiteral(std::string& result, std::string_view str)
+{
+	static constexpr std::string_view HexDigits{"0123456789abcdef"};
+	constexpr std::size_t MaxEscapeLength = 6;
+	const auto find = findEscape();
+
+	// The output is written through a pointer because appending many short pieces to the string is slow when escapes are frequent.
+	// The string only grows when the escape sequences don't fit anymore.
+	auto size = result.size();
+	result.resize(size + str.size() + 2);
+	result[size++] = '\"';
+
+	while(!str.empty())
+	{
+		// Escapes are often close together, e.g. the quotes in embedded json, where calling the kernel doesn't pay off
+		auto length = std::size_t(0);
+		const auto scalarLength = std::min(str.size(), std::size_t(16));
+
+		while(length < scalarLength && !needsEscape(str[length]))
+			++length;
+
+		if(length == scalarLength)
+			length += find(str.data() + length, str.size() - length);
+
+		std::memcpy(result.data() + size, str.data(), length);
+		size += length;
+
+		if(length == str.size())
+			break;
+
+		const char c = str[length];
+		str.remove_prefix(length + 1);
+
+		if(const auto required = size + MaxEscapeLength + str.size() + 1; required > result.size())
+			result.resize(std::max(required, result.size() + result.size() / 2));
+
+		auto* out = result.data() + size;
+		out[0] = '\\';
+
+		switch(c)
+		{
+		case '\b':
+			out[1] = 'b';
+			break;
+		case '\t':
+			out[1] = 't';
+			break;
+		case '\n':
+			out[1] = 'n';
+			break;
+		case '\f':
+			out[1] = 'f';
+			break;
+		case '\r':
+			out[1] = 'r';
+			break;
+		case '\"':
+			out[1] = '\"';
+			break;
+		case '\\':
+			out[1] = '\\';
+			break;
+		default:
+			// Other control characters don't have a short escape sequence in json
+			out[1] = 'u';
+			out[2] = '0';
+			out[3] = '0';
+			out[4] = HexDigits[static_cast<unsigned char>(c) >> 4];
+			out[5] = HexDigits[static_cast<unsigned char>(c) & 0xF];
+			size += MaxEscapeLength;
+			continue;
+		}
+
+		size += 2;
+	}
+
+	result[size++] = '\"';
+	result.resize(size);
+}
+
+void stringifyImplementation(const Any& json, std::string& str, std::size_t indentLevel, bool format)
+{
+	const auto getIndent = [&indentLevel, format]()
+	{
+		if(!format)
+			return std::string_view{};
+
+		static constexpr std::string_view Tabs{"\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t"};
+		return Tabs.substr(0, std::min(indentLevel, Tabs.size()));
+	};
+
+	std::string_view keySep{":"};
+	std::string_view valueSep{","};
+	std::string_view listStart;
+	std::string_view listEnd;
+
+	if(format)
+	{
+		keySep = ": ";
+		valueSep = ",\n";
+		listStart = "\n";
+		listEnd = "\n";
+	}
+
+	if(json.isNull())
+	{
+		str += NullValueString;
+	}
+	else if(json.isBoolean())
+	{
+		str += json.boolean() ? TrueValueString : FalseValueString;
+	}
+	else if(json.isInteger())
+	{
+		appendInteger(str, json.integer());
+	}
+	else if(json.isDecimal())
+	{
+		appendDecimal(str, json.decimal());
+	}
+	else if(json.isString())
+	{
+		appendStringLiteral(str, json.string());
+	}
+	else if(json.isObject())
+	{
+		const auto& obj = json.object();
+
+		str += '{';
+
+		if(auto it = obj.begin(); it != obj.end())
+		{
+			str += listStart;
+			++indentLevel;
+			str += getIndent();
+			appendStringLiteral(str, it->first);
+			str += keySep;
+			stringifyImplementation(it->second, str, indentLevel, format);
+			++it;
+
+			while(it != obj.end())
+			{
+				str += valueSep;
+				str += getIndent();
+				appendStringLiteral(str, it->first);
+				str += keySep;
+				stringifyImplementation(it->second, str, indentLevel, format);
+				++it;
+			}
+
+			str += listEnd;
+			--indentLevel;
+			str += getIndent();
+		}
+
+		str += '}';
+	}
+	else if(json.isIntegerArray())
+	{
+		const auto& integers = json.integerArray();
+
+		str += '[';
+
+		if(!integers.empty())
+		{
+			if(format)
+			{
+				str += listStart;
+				++indentLevel;
+
+				for(auto it = integers.begin(); it != integers.end(); ++it)
+				{
+					if(it != integers.begin())
+						str += valueSep;
+
+					str += getIndent();
+					appendInteger(str, *it);
+				}
+
+				str += listEnd;
+				--indentLevel;
+				str += getIndent();
+			}
+			else
+			{
+				appendIntegers(str, std::span{integers});
+			}
+		}
+
+		str += ']';
+	}
+	else if(json.isArray())
+	{
+		const auto& array = json.array();
+
+		str += '[';
+
+		if(auto it = array.begin(); it != array.end())
+		{
+			str += listStart;
+			++indentLevel;
+			str += getIndent();
+			stringifyImplementation(*it, str, indentLevel, format);
+			++it;
+
+			while(it != array.end())
+			{
+				str += valueSep;
+				str += getIndent();
+				stringifyImplementation(*it, str, indentLevel, format);
+				++it;
+			}
+
+			str += listEnd;
+			--indentLevel;
+			str += getIndent();
+		}
+
+		str += ']';
+	}
+}
+
+} // namespace
+
+namespace{
+
+/*
+ * CBOR
+ * Values of a json::Any are written with definite lengths while the Writer uses indefinite ones for
+ * objects and arrays since it doesn't know their size up front. Integer arrays are written as a typed
+ * array of little endian 32 bit integers (RFC 8746) which is copied as a whole when reading it.
+ */
+
+constexpr std::uint8_t  CborUnsigned      = 0 << 5;
+constexpr std::uint8_t  CborNegative      = 1 << 5;
+constexpr std::uint8_t  CborBytes         = 2 << 5;
+constexpr std::uint8_t  CborText          = 3 << 5;
+constexpr std::uint8_t  CborArray         = 4 << 5;
+constexpr std::uint8_t  CborMap           = 5 << 5;
+constexpr std::uint8_t  CborTag           = 6 << 5;
+constexpr std::uint8_t  CborSimple        = 7 << 5;
+constexpr std::uint8_t  CborIndefinite    = 31;
+constexpr std::uint8_t  CborFalse         = 0xf4;
+constexpr std::uint8_t  CborTrue          = 0xf5;
+constexpr std::uint8_t  CborNull          = 0xf6;
+constexpr std::uint8_t  CborFloat16       = 0xf9;
+constexpr std::uint8_t  CborFloat32       = 0xfa;
+constexpr std::uint8_t  CborFloat64       = 0xfb;
+constexpr std::uint8_t  CborBreak         = 0xff;
+constexpr std::uint64_t CborInt32ArrayTag = 78; // sint32, little endian
+
+void appendCborHead(std::string& str, std::uint8_t majorType, std::uint64_t argument)
+{
+	char        head[9];
+	std::size_t argumentSize = 0;
+
+	if(argument < 24)
+	{
+		str += static_cast<char>(majorType | argument);
+		return;
+	}
+
+	if(argument <= 0xff)
+	{
+		head[0] = static_cast<char>(majorType | 24);
+		argumentSize = 1;
+	}
+	else if(argument <= 0xffff)
+	{
+		head[0] = static_cast<char>(majorType | 25);
+		argumentSize = 2;
+	}
+	else if(argument <= 0xffffffff)
+	{
+		head[0] = static_cast<char>(majorType | 26);
+		argumentSize = 4;
+	}
+	else
+	{
+		head[0] = static_cast<char>(majorType | 27);
+		argumentSize = 8;
+	}
+
+	for(std::size_t i = 0; i < argumentSize; ++i)
+		head[argumentSize - i] = static_cast<char>((argument >> (i * 8)) & 0xff);
+
+	str.append(head, argumentSize + 1);
+}
+
+void appendCborInteger(std::string& str, std::int64_t integer)
+{
+	if(integer >= 0)
+		appendCborHead(str, CborUnsigned, static_cast<std::uint64_t>(integer));
+	else
+		appendCborHead(str, CborNegative, static_cast<std::uint64_t>(-1 - integer));
+}
+
+void appendCborDecimal(std::string& str, Decimal decimal)
+{
+	str += static_cast<char>(CborFloat64);
+	const auto bits = std::bit_cast<std::uint64_t>(decimal);
+
+	char bytes[8];
+	for(std::size_t i = 0; i < 8; ++i)
+		bytes[7 - i] = static_cast<char>((bits >> (i * 8)) & 0xff);
+
+	str.append(bytes, 8);
+}
+
+void appendCborString(std::string& str, std::string_view value)
+{
+	appendCborHead(str, CborText, value.size());
+	str += value;
+}
+
+// Values have to fit into an Integer
+template<typename T>
+void appendCborIntegers(std::string& str, std::span<const T> values)
+{
+	static_assert(sizeof(T) == sizeof(Integer));
+
+	appendCborHead(str, CborTag, CborInt32ArrayTag);
+	appendCborHead(str, CborBytes, values.size() * sizeof(T));
+
+	if constexpr(std::endian::native == std::endian::little)
+	{
+		str.append(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+	}
+	else
+	{
+		for(const auto value : values)
+		{
+			const auto bits = static_cast<std::uint32_t>(value);
+			const char bytes[4] = {static_cast<char>(bits & 0xff), static_cast<char>((bits >> 8) & 0xff),
+			                       static_cast<char>((bits >> 16) & 0xff), static_cast<char>(bits >> 24)};
+			str.append(bytes, 4);
+		}
+	}
+}
+
+void appendCbor(std::string& str, const Any& json)
+{
+	if(json.isNull())
+	{
+		str += static_cast<char>(CborNull);
+	}
+	else if(json.isBoolean())
+	{
+		str += static_cast<char>(json.boolean() ? CborTrue : CborFalse);
+	}
+	else if(json.isInteger())
+	{
+		appendCborInteger(str, json.integer());
+	}
+	else if(json.isDecimal())
+	{
+		appendCborDecimal(str, json.decimal());
+	}
+	else if(json.isString())
+	{
+		appendCborString(str, json.string());
+	}
+	else if(json.isObject())
+	{
+		const auto& obj = json.object();
+		appendCborHead(str, CborMap, obj.size());
+
+		for(const auto& [key, value] : obj)
+		{
+			appendCborString(str, key);
+			appendCbor(str, value);
+		}
+	}
+	else if(json.isIntegerArray())
+	{
+		appendCborIntegers(str, std::span{json.integerArray()});
+	}
+	else if(json.isArray())
+	{
+		const auto& array = json.array();
+		appendCborHead(str, CborArray, array.size());
+
+		for(const auto& value : array)
+			appendCbor(str, value);
+	}
+}
+
+/*
+ * CborParser
+ * Uses a stack of open objects and arrays like Parser so deeply nested data can't overflow the call stack.
+ */
+
+class CborParser{
+public:
+	CborParser(std::string_view data, const Allocator& allocator = {})
+		: m_data{data}
+		, m_allocator{allocator}
+	{
+		m_stack.reserve(10);
+	}
+
+	Any parse()
+	{
+		Any result;
+		readValue(result);
+
+		while(!m_stack.empty())
+		{
+			auto& container = m_stack.back();
+
+			if(container.indefinite ? peekByte() == CborBreak : container.remaining == 0)
+			{
+				if(container.indefinite)
+					++m_pos;
+
+				m_stack.pop_back();
+				continue;
+			}
+
+			if(!container.indefinite)
+				--container.remaining;
+
+			auto& value = *container.value;
+
+			if(value.isObject())
+				readMember(value.object());
+			else if(value.isIntegerArray())
+				readInteger(value);
+			else
+				readValue(value.array().emplace_back());
+		}
+
+		if(m_pos != m_data.size())
+			throw ParseError{"Trailing bytes in CBOR data", m_pos};
+
+		return result;
+	}
+
+private:
+	struct Container{
+		Any*          value;
+		std::uint64_t remaining;
+		bool          indefinite;
+	};
+
+	std::string_view       m_data;
+	std::size_t            m_pos = 0;
+	const Allocator        m_allocator;
+	std::vector<Container> m_stack;
+
+	std::uint8_t peekByte() const
+	{
+		if(m_pos == m_data.size())
+			throw ParseError{"Unexpected end of input", m_pos};
+
+		return static_cast<std::uint8_t>(m_data[m_pos]);
+	}
+
+	std::uint8_t readByte()
+	{
+		const auto byte = peekByte();
+		++m_pos;
+
+		return byte;
+	}
+
+	std::string_view readBytes(std::uint64_t size)
+	{
+		if(size > m_data.size() - m_pos)
+			throw ParseError{"Unexpected end of input", m_data.size()};
+
+		const auto bytes = m_data.substr(m_pos, static_cast<std::size_t>(size));
+		m_pos += bytes.size();
+
+		return bytes;
+	}
+
+	std::uint64_t readArgument(std::uint8_t initialByte)
+	{
+		const auto additional = static_cast<std::uint8_t>(initialByte & 0x1f);
+
+		if(additional < 24)
+			return additional;
+
+		if(additional > 27)
+			throw ParseError{"Invalid CBOR argument", m_pos - 1};
+
+		std::uint64_t argument = 0;
+
+		for(const auto byte : readBytes(std::uint64_t{1} << (additional - 24)))
+			argument = (argument << 8) | static_cast<std::uint8_t>(byte);
+
+		return argument;
+	}
+
+	// Containers need at least one byte per element so this limits the memory reserved for them
+	std::size_t checkedCount(std::uint64_t count) const
+	{
+		if(count > m_data.size() - m_pos)
+			throw ParseError{"Unexpected end of input", m_data.size()};
+
+		return static_cast<std::size_t>(count);
+	}
+
+	static Any integerValue(std::uint8_t majorType, std::uint64_t argument)
+	{
+		constexpr auto max = static_cast<std::uint64_t>(std::numeric_limits<Integer>::max());
+
+		if(majorType == CborUnsigned)
+		{
+			if(argument <= max)
+				return static_cast<Integer>(argument);
+
+			return static_cast<Decimal>(argument);
+		}
+
+		if(argument <= max)
+			return static_cast<Integer>(-1 - static_cast<std::int64_t>(argument));
+
+		return -1.0 - static_cast<Decimal>(argument);
+	}
+
+	static Decimal halfToDecimal(std::uint16_t half)
+	{
+		const auto exponent = (half >> 10) & 0x1f;
+		const auto mantissa = half & 0x3ff;
+		Decimal    value;
+
+		if(exponent == 0)
+			value = std::ldexp(mantissa, -24);
+		else if(exponent != 31)
+			value = std::ldexp(mantissa + 1024, exponent - 25);
+		else
+			value = mantissa == 0 ? std::numeric_limits<Decimal>::infinity() : std::numeric_limits<Decimal>::quiet_NaN();
+
+		return (half & 0x8000) ? -value : value;
+	}
+
+	String readString(std::uint8_t initialByte)
+	{
+		if((initialByte & 0x1f) != CborIndefinite)
+			return String{readBytes(readArgument(initialByte))};
+
+		// Indefinite length strings are split into definite length chunks
+		String str;
+
+		for(auto byte = readByte(); byte != CborBreak; byte = readByte())
+		{
+			if((byte & 0xe0) != CborText || (byte & 0x1f) == CborIndefinite)
+				throw ParseError{"Invalid CBOR string chunk", m_pos - 1};
+
+			str += readBytes(readArgument(byte));
+		}
+
+		return str;
+	}
+
+	void readMember(Object& object)
+	{
+		const auto keyPos      = m_pos;
+		const auto initialByte = readByte();
+
+		if((initialByte & 0xe0) != CborText)
+			throw ParseError{"Expected a string as object key", keyPos};
+
+		auto [it, inserted] = (initialByte & 0x1f) != CborIndefinite ? object.try_emplace(Key::plain(String{readBytes(readArgument(initialByte))}))
+		                                                               : object.try_emplace(Key::plain(readString(initialByte)));
+
+		if(!inserted)
+			throw ParseError{"Duplicate key '" + it->first.str() + "'", keyPos};
+
+		readValue(it->second);
+	}
+
+	// Keeps the array packed as long as it only contains integers
+	void readInteger(Any& value)
+	{
+		const auto initialByte = peekByte();
+		const auto majorType   = static_cast<std::uint8_t>(initialByte & 0xe0);
+
+		if(majorType == CborUnsigned || majorType == CborNegative)
+		{
+			++m_pos;
+			auto integer = integerValue(majorType, readArgument(initialByte));
+
+			if(integer.isInteger())
+			{
+				value.integerArray().push_back(integer.integer());
+				return;
+			}
+
+			value.array().push_back(std::move(integer));
+			return;
+		}
+
+		readValue(value.array().emplace_back());
+	}
+
+	void readIntegerArray(Any& value)
+	{
+		const auto pos         = m_pos;
+		const auto initialByte = readByte();
+
+		if((initialByte & 0xe0) != CborBytes || (initialByte & 0x1f) == CborIndefinite)
+			throw ParseError{"Expected a byte string in typed array", pos};
+
+		const auto bytes = readBytes(readArgument(initialByte));
+
+		if(bytes.size() % sizeof(Integer) != 0)
+			throw ParseError{"Invalid typed array length", pos};
+
+		IntegerArray integers(bytes.size() / sizeof(Integer), m_allocator);
+
+		if constexpr(std::endian::native == std::endian::little)
+		{
+			if(!bytes.empty())
+				std::memcpy(integers.data(), bytes.data(), bytes.size());
+		}
+		else
+		{
+			for(std::size_t i = 0; i < integers.size(); ++i)
+			{
+				std::uint32_t bits = 0;
+
+				for(std::size_t b = 0; b < sizeof(Integer); ++b)
+					bits |= static_cast<std::uint32_t>(static_cast<std::uint8_t>(bytes[i * sizeof(Integer) + b])) << (b * 8);
+
+				integers[i] = static_cast<Integer>(bits);
+			}
+		}
+
+		value = std::move(integers);
+	}
+
+	void readValue(Any& value)
+	{
+		const auto pos         = m_pos;
+		const auto initialByte = readByte();
+		const auto majorType   = static_cast<std::uint8_t>(initialByte & 0xe0);
+
+		switch(majorType)
+		{
+		case CborUnsigned:
+		case CborNegative:
+			value = integerValue(majorType, readArgument(initialByte));
+			break;
+		case CborText:
+			value = Any{std::allocator_arg, m_allocator, readString(initialByte)};
+			break;
+		case CborArray:
+		case CborMap:
+		{
+			const auto indefinite = (initialByte & 0x1f) == CborIndefinite;
+			const auto count      = indefinite ? 0 : checkedCount(readArgument(initialByte));
+
+			if(majorType == CborMap)
+			{
+				Object object{m_allocator};
+				object.reserve(count);
+				value = std::move(object);
+			}
+			else
+			{
+				// Arrays starting with an integer are likely to only contain integers
+				const auto first = m_pos < m_data.size() ? static_cast<std::uint8_t>(m_data[m_pos] & 0xe0) : CborSimple;
+
+				if((first == CborUnsigned || first == CborNegative) && (indefinite || count > 0))
+				{
+					IntegerArray integers{m_allocator};
+					integers.reserve(count);
+					value = std::move(integers);
+				}
+				else
+				{
+					Array array{m_allocator};
+					array.reserve(count);
+					value = std::move(array);
+				}
+			}
+
+			m_stack.push_back({&value, count, indefinite});
+			break;
+		}
+		case CborTag:
+			if(readArgument(initialByte) != CborInt32ArrayTag)
+				throw ParseError{"Unsupported CBOR tag", pos};
+
+			readIntegerArray(value);
+			break;
+		case CborSimple:
+			switch(initialByte)
+			{
+			case CborFalse:
+				value = false;
+				break;
+			case CborTrue:
+				value = true;
+				break;
+			case CborNull:
+				value = nullptr;
+				break;
+			case CborFloat16:
+				value = halfToDecimal(static_cast<std::uint16_t>(readArgument(initialByte)));
+				break;
+			case CborFloat32:
+				value = static_cast<Decimal>(std::bit_cast<float>(static_cast<std::uint32_t>(readArgument(initialByte))));
+				break;
+			case CborFloat64:
+				value = std::bit_cast<Decimal>(readArgument(initialByte));
+				break;
+			default:
+				throw ParseError{"Unsupported CBOR simple value", pos};
+			}
+			break;
+		default:
+			throw ParseError{"Unsupported CBOR byte string", pos};
+		}
+	}
+};
+
+} // namespace
+
+namespace{
+
+/*
+ * Key atoms
+ * Fixed size open addressing table that is only ever appended to. Lookups don't
+ * lock, interning new names is serialized by a mutex.
+ */
+
+constexpr std::size_t KeyAtomTableSize = 4096;
+constexpr std::size_t MaxKeyAtomCount  = KeyAtomTableSize / 2;
+constexpr std::size_t MaxKeyAtomLength = 64; // Longer keys are usually data like uris and never match
+
+std::atomic<const KeyAtom*> g_keyAtoms[KeyAtomTableSize];
+std::mutex                  g_keyAtomMutex;
+std::atomic<std::size_t>    g_keyAtomCount{0};
+
+const KeyAtom* findKeyAtom(std::string_view str, std::size_t hash)
+{
+	constexpr auto mask = KeyAtomTableSize - 1;
+
+	for(auto slot = hash & mask;; slot = (slot + 1) & mask)
+	{
+		const auto* atom = g_keyAtoms[slot].load(std::memory_order_acquire);
+
+		if(!atom || (atom->hash == hash && atom->text == str))
+			return atom;
+	}
+}
+
+const KeyAtom* findKeyAtom(std::string_view str)
+{
+	if(str.size() > MaxKeyAtomLength || g_keyAtomCount.load(std::memory_order_relaxed) == 0)
+		return nullptr;
+
+	return findKeyAtom(str, Key::hashString(str));
+}
+
+const KeyAtom* internKeyAtom(std::string_view str)
+{
+	constexpr auto mask = KeyAtomTableSize - 1;
+	const auto     hash = Key::hashString(str);
+
+	std::lock_guard lock{g_keyAtomMutex};
+
+	if(const auto* atom = findKeyAtom(str, hash))
+		return atom;
+
+	// Names beyond the limits just don't get the fast path
+	if(str.size() > MaxKeyAtomLength || g_keyAtomCount.load(std::memory_order_relaxed) >= MaxKeyAtomCount)
+		return nullptr;
+
+	auto slot = hash & mask;
+
+	while(g_keyAtoms[slot].load(std::memory_order_relaxed))
+		slot = (slot + 1) & mask;
+
+	// Atoms live until the program exits
+	const auto* atom = new KeyAtom{String{str}, hash};
+	g_keyAtoms[slot].store(atom, std::memory_order_release);
+	g_keyAtomCount.fetch_add(1, std::memory_order_relaxed);
+
+	return atom;
+}
+
+} // namespace
+
+/*
+ * Key
+ */
+
+Key::Key(std::string_view str)
+	: m_atom{findKeyAtom(str)}
+	, m_text{m_atom ? std::string_view{} : str}
+{
+}
+
+Key::Key(String&& str)
+	: m_atom{findKeyAtom(str)}
+	, m_text{m_atom ? String{} : std::move(str)}
+{
+}
+
+Key Key::intern(std::string_view str)
+{
+	if(const auto* atom = internKeyAtom(str))
+		return Key{atom};
+
+	return Key{str};
+}
+
+Key Key::plain(String&& str)
+{
+	Key key;
+	key.m_text = std::move(str);
+
+	return key;
+}
+
+/*
+ * Object
+ */
+
+Object::Object(std::initializer_list<value_type> init, const Allocator& allocator)
+	: m_entries(allocator)
+	, m_index(allocator)
+{
+	m_entries.reserve(init.size());
+
+	for(const auto& [key, value] : init)
+		try_emplace(key, value);
+}
+
+Object::Object(const Object& other, const Allocator& allocator)
+	: m_entries(other.m_entries, allocator)
+	, m_index(other.m_index, allocator)
+{
+}
+
+Object::Object(Object&& other, const Allocator& allocator)
+	: m_entries(std::move(other.m_entries), allocator)
+	, m_index(std::move(other.m_index), allocator)
+{
+	other.clear();
+}
+
+void Object::clear() noexcept
+{
+	m_entries.clear();
+	m_index.clear();
+}
+
+Any& Object::get(const Key& key)
+{
+	if(const auto it = find(key); it != end())
+		return it->second;
+
+	throw TypeError{"Missing key '" + key.str() + '\''};
+}
+
+const Any& Object::get(const Key& key) const
+{
+	if(const auto it = find(key); it != end())
+		return it->second;
+
+	throw TypeError{"Missing key '" + key.str() + '\''};
+}
+
+Any& Object::get(std::string_view key)
+{
+	if(const auto it = find(key); it != end())
+		return it->second;
+
+	throw TypeError{"Missing key '" + std::string{key} + '\''};
+}
+
+const Any& Object::get(std::string_view key) const
+{
+	if(const auto it = find(key); it != end())
+		return it->second;
+
+	throw TypeError{"Missing key '" + std::string{key} + '\''};
+}
+
+Object::iterator Object::erase(const_iterator pos)
+{
+	const auto it = m_entries.erase(pos);
+	rebuildIndex();
+
+	return it;
+}
+
+std::size_t Object::erase(const Key& key)
+{
+	if(const auto it = find(key); it != end())
+	{
+		erase(it);
+		return 1;
+	}
+
+	return 0;
+}
+
+bool Object::operator==(const Object& other) const
+{
+	if(size() != other.size())
+		return false;
+
+	for(const auto& [key, value] : m_entries)
+	{
+		const auto it = other.find(key);
+
+		if(it == other.end() || it->second != value)
+			return false;
+	}
+
+	return true;
+}
+
+std::size_t Object::indexOf(const Key& key) const
+{
+	if(m_index.empty())
+	{
+		for(std::size_t i = 0; i < m_entries.size(); ++i)
+		{
+			if(m_entries[i].first == key)
+				return i;
+		}
+
+		return m_entries.size();
+	}
+
+	const auto mask = m_index.size() - 1;
+
+	for(auto slot = key.hash() & mask; m_index[slot] != 0; slot = (slot + 1) & mask)
+	{
+		const auto i = m_index[slot] - 1;
+
+		if(m_entries[i].first == key)
+			return i;
+	}
+
+	return m_entries.size();
+}
+
+std::size_t Object::indexOf(std::string_view key) const
+{
+	if(m_index.empty())
+	{
+		for(std::size_t i = 0; i < m_entries.size(); ++i)
+		{
+			if(m_entries[i].first.str() == key)
+				return i;
+		}
+
+		return m_entries.size();
+	}
+
+	const auto mask = m_index.size() - 1;
+
+	for(auto slot = Key::hashString(key) & mask; m_index[slot] != 0; slot = (slot + 1) & mask)
+	{
+		const auto i = m_index[slot] - 1;
+
+		if(m_entries[i].first.str() == key)
+			return i;
+	}
+
+	return m_entries.size();
+}
+
+void Object::indexLastEntry()
+{
+	if(m_entries.size() <= LinearScanLimit)
+		return;
+
+	// Keep the table at most half full
+	if(m_entries.size() * 2 > m_index.size())
+	{
+		rebuildIndex();
+		return;
+	}
+
+	const auto mask = m_index.size() - 1;
+	auto       slot = m_entries.back().first.hash() & mask;
+
+	while(m_index[slot] != 0)
+		slot = (slot + 1) & mask;
+
+	m_index[slot] = static_cast<std::uint32_t>(m_entries.size());
+}
+
+void Object::rebuildIndex()
+{
+	m_index.clear();
+
+	if(m_entries.size() <= LinearScanLimit)
+		return;
+
+	m_index.resize(std::bit_ceil(m_entries.size() * 4));
+	const auto mask = m_index.size() - 1;
+
+	for(std::size_t i = 0; i < m_entries.size(); ++i)
+	{
+		auto slot = m_entries[i].first.hash() & mask;
+
+		while(m_index[slot] != 0)
+			slot = (slot + 1) & mask;
+
+		m_index[slot] = static_cast<std::uint32_t>(i + 1);
+	}
+}
+
+/*
+ * Any
+ */
+
+Any::Any(const Object& value)
+	: m_object{Allocator{}.new_object<Object>(value)}
+	, m_type{Type::Object}
+{
+}
+
+Any::Any(Object&& value)
+	: m_object{Allocator{value.get_allocator()}.new_object<Object>(std::move(value))}
+	, m_type{Type::Object}
+{
+}
+
+Any::Any(const Array& value)
+	: m_array{Allocator{}.new_object<Array>(value)}
+	, m_type{Type::Array}
+{
+}
+
+Any::Any(Array&& value)
+	: m_array{Allocator{value.get_allocator()}.new_object<Array>(std::move(value))}
+	, m_type{Type::Array}
+{
+}
+
+Any::Any(const IntegerArray& value)
+	: m_integers{newIntegers(Allocator{}, IntegerArray{value})}
+	, m_type{Type::IntegerArray}
+{
+}
+
+Any::Any(IntegerArray&& value)
+	: m_integers{newIntegers(Allocator{value.get_allocator()}, std::move(value))}
+	, m_type{Type::IntegerArray}
+{
+}
+
+Any::Any(std::allocator_arg_t, const Allocator& allocator, const Any& other)
+	: m_bits{other.m_bits}
+	, m_type{other.m_type}
+{
+	auto alloc = allocator;
+
+	switch(m_type)
+	{
+	case Type::String:
+		m_string = newString(allocator, String{other.m_string->value});
+		break;
+	case Type::Object:
+		m_object = alloc.new_object<Object>(*other.m_object);
+		break;
+	case Type::Array:
+		m_array = alloc.new_object<Array>(*other.m_array);
+		break;
+	case Type::IntegerArray:
+		m_integers = newIntegers(allocator, IntegerArray{other.m_integers->values, allocator});
+		break;
+	case Type::Shared:
+		// Shared values are never allocated from an arena so they can be referenced from anywhere
+		m_shared->references.fetch_add(1, std::memory_order_relaxed);
+		break;
+	default:
+		break;
+	}
+}
+
+Any::Any(std::allocator_arg_t, const Allocator& allocator, Any&& other)
+	: Any{std::move(other)}
+{
+	auto alloc = allocator;
+
+	switch(m_type)
+	{
+	case Type::String:
+		if(*m_string->resource != *allocator.resource())
+		{
+			auto* string = m_string;
+			m_string = newString(allocator, std::move(string->value));
+			Allocator{string->resource}.delete_object(string);
+		}
+		break;
+	case Type::Object:
+		if(m_object->get_allocator() != allocator)
+		{
+			auto* object = m_object;
+			m_object = alloc.new_object<Object>(std::move(*object));
+			Allocator{object->get_allocator()}.delete_object(object);
+		}
+		break;
+	case Type::Array:
+		if(m_array->get_allocator() != allocator)
+		{
+			auto* array = m_array;
+			m_array = alloc.new_object<Array>(std::move(*array));
+			Allocator{array->get_allocator()}.delete_object(array);
+		}
+		break;
+	case Type::IntegerArray:
+		if(m_integers->values.get_allocator() != allocator)
+		{
+			auto* integers = m_integers;
+			m_integers = newIntegers(allocator, IntegerArray{integers->values, allocator});
+			deleteIntegers(integers);
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+Any Any::share(Any&& value)
+{
+	// Copying scalars is cheaper than sharing them
+	if(value.m_type < Type::String || value.m_type == Type::Shared)
+		return std::move(value);
+
+	Any shared;
+	shared.m_shared = Allocator{}.new_object<SharedBox>(1u, Any{std::allocator_arg, Allocator{}, std::move(value)});
+	shared.m_type = Type::Shared;
+
+	return shared;
+}
+
+Any& Any::operator=(const Any& other)
+{
+	if(this != &other)
+		*this = Any{other};
+
+	return *this;
+}
+
+Any& Any::operator=(Any&& other) noexcept
+{
+	if(this != &other)
+	{
+		reset();
+		m_bits = other.m_bits;
+		m_type = other.m_type;
+		other.m_type = Type::Null;
+	}
+
+	return *this;
+}
+
+bool Any::operator==(const Any& other) const
+{
+	if(m_type == Type::Shared || other.m_type == Type::Shared)
+	{
+		if(m_type == other.m_type && m_shared == other.m_shared)
+			return true;
+
+		return target() == other.target();
+	}
+
+	if(m_type != other.m_type)
+	{
+		// Packed and regular arrays with the same integers are equal
+		if(!isArray() || !other.isArray())
+			return false;
+
+		const auto& integers = m_type == Type::IntegerArray ? m_integers->values : other.m_integers->values;
+		const auto& array = m_type == Type::Array ? *m_array : *other.m_array;
+
+		return std::equal(integers.begin(), integers.end(), array.begin(), array.end(),
+		                  [](Integer integer, const Any& value){ return value.isInteger() && value.m_integer == integer; });
+	}
+
+	switch(m_type)
+	{
+	case Type::Null:
+		return true;
+	case Type::Boolean:
+		return m_boolean == other.m_boolean;
+	case Type::Integer:
+		return m_integer == other.m_integer;
+	case Type::Decimal:
+		return m_decimal == other.m_decimal;
+	case Type::String:
+		return m_string->value == other.m_string->value;
+	case Type::Object:
+		return *m_object == *other.m_object;
+	case Type::Array:
+		return *m_array == *other.m_array;
+	case Type::IntegerArray:
+		return m_integers->values == other.m_integers->values;
+	case Type::Shared:
+		break;
+	}
+
+	return false;
+}
+
+Any::StringBox* Any::newString(const Allocator& allocator, String&& value)
+{
+	return Allocator{allocator}.new_object<StringBox>(std::move(value), allocator.resource());
+}
+
+Any::IntegerArrayBox* Any::newIntegers(const Allocator& allocator, IntegerArray&& values)
+{
+	return Allocator{allocator}.new_object<IntegerArrayBox>(std::move(values), nullptr);
+}
+
+void Any::deleteIntegers(IntegerArrayBox* integers) noexcept
+{
+	Allocator allocator{integers->values.get_allocator()};
+
+	if(auto* unpacked = integers->unpacked.load(std::memory_order_acquire))
+		allocator.delete_object(unpacked);
+
+	allocator.delete_object(integers);
+}
+
+IntegerArray& Any::integerArray()
+{
+	unshare();
+	expect(Type::IntegerArray);
+
+	// The values are about to change so a previously unpacked copy would be stale
+	if(m_integers->unpacked.load(std::memory_order_relaxed))
+	{
+		auto* unpacked = m_integers->unpacked.exchange(nullptr, std::memory_order_acquire);
+		Allocator{m_integers->values.get_allocator()}.delete_object(unpacked);
+	}
+
+	return m_integers->values;
+}
+
+const Array& Any::unpackedIntegers() const
+{
+	expect(Type::IntegerArray);
+
+	if(auto* unpacked = m_integers->unpacked.load(std::memory_order_acquire))
+		return *unpacked;
+
+	Allocator allocator{m_integers->values.get_allocator()};
+	auto* array = allocator.new_object<Array>(m_integers->values.begin(), m_integers->values.end());
+	Array* expected = nullptr;
+
+	// Another thread might have unpacked the values at the same time
+	if(!m_integers->unpacked.compare_exchange_strong(expected, array, std::memory_order_acq_rel))
+	{
+		allocator.delete_object(array);
+		return *expected;
+	}
+
+	return *array;
+}
+
+void Any::unpackIntegers()
+{
+	expect(Type::IntegerArray);
+
+	auto* integers = m_integers;
+	Allocator allocator{integers->values.get_allocator()};
+	auto* array = integers->unpacked.exchange(nullptr, std::memory_order_acquire);
+
+	if(!array)
+		array = allocator.new_object<Array>(integers->values.begin(), integers->values.end());
+
+	deleteIntegers(integers);
+	m_array = array;
+	m_type = Type::Array;
+}
+
+void Any::release() noexcept
+{
+	switch(m_type)
+	{
+	case Type::String:
+		Allocator{m_string->resource}.delete_object(m_string);
+		break;
+	case Type::Object:
+		Allocator{m_object->get_allocator()}.delete_object(m_object);
+		break;
+	case Type::Array:
+		Allocator{m_array->get_allocator()}.delete_object(m_array);
+		break;
+	case Type::IntegerArray:
+		deleteIntegers(m_integers);
+		break;
+	case Type::Shared:
+		if(m_shared->references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			Allocator{}.delete_object(m_shared);
+		break;
+	default:
+		break;
+	}
+
+	m_type = Type::Null;
+}
+
+void Any::copySharedValue()
+{
+	auto& shared = m_shared->value;
+
+	// The last reference doesn't need to copy the value
+	if(m_shared->references.load(std::memory_order_acquire) == 1)
+		*this = Any{std::move(shared)};
+	else
+		*this = Any{shared};
+}
+
+Document::Document(std::size_t initialArenaSize)
+	: m_arena{initialArenaSize > 0 ? std::make_unique<std::pmr::monotonic_buffer_resource>(initialArenaSize)
+	                               : std::make_unique<std::pmr::monotonic_buffer_resource>()}
+{
+}
+
+Document& Document::operator=(Document&& other)
+{
+	if(this != &other)
+	{
+		// The current tree has to be gone before its arena is released
+		m_root  = nullptr;
+		m_arena = std::move(other.m_arena);
+		m_root  = std::move(other.m_root);
+	}
+
+	return *this;
+}
+
+class Reader::Implementation : private Tokenizer{
+public:
+	using Token = Reader::Token;
+
+	Implementation(std::string_view text)
+		: Tokenizer{text}
+	{
+	}
+
+	Token next()
+	{
+		if(m_keyRead)
+		{
+			m_keyRead = false;
+			return readValue();
+		}
+
+		if(m_containers.empty())
+		{
+			if(m_token == Token::End || m_rootRead)
+			{
+				if(!atEnd())
+					throw ParseError{"Trailing characters in json", currentTextOffset()};
+
+				return m_token = Token::End;
+			}
+
+			m_rootRead = true;
+			return readValue();
+		}
+
+		if(atEnd())
+			throw ParseError{"Unexpected end of input", m_text.size()};
+
+		auto&      container = m_containers.back();
+		const auto endChar   = container.isObject ? '}' : ']';
+
+		if(currentChar() == endChar)
+		{
+			setTokenText(currentTextOffset(), currentTextOffset() + 1);
+			advance();
+			m_containers.pop_back();
+			return m_token = (endChar == '}' ? Token::EndObject : Token::EndArray);
+		}
+
+		if(!container.isEmpty)
+		{
+			if(currentChar() != ',')
+				throw ParseError{"Expected ','", currentTextOffset()};
+
+			const auto pos = currentTextOffset();
+			advance();
+
+			if(!atEnd() && currentChar() == endChar)
+				throw ParseError{"Trailing ','", pos};
+		}
+
+		container.isEmpty = false;
+
+		if(container.isObject)
+			return readKey();
+
+		return readValue();
+	}
+
+	Token token() const
+	{
+		return m_token;
+	}
+
+	// Moves to the end of the container that was just started without reading the tokens in between
+	void skipContainer()
+	{
+		assert(m_token == Token::StartObject || m_token == Token::StartArray);
+
+		// Brackets inside of strings are never reported by the StructuralIndexer
+		for(std::size_t depth = 1;; advance())
+		{
+			if(atEnd())
+				throw ParseError{"Unexpected end of input", m_text.size()};
+
+			const auto c = currentChar();
+
+			if(c == '{' || c == '[')
+			{
+				++depth;
+			}
+			else if((c == '}' || c == ']') && --depth == 0)
+			{
+				setTokenText(currentTextOffset(), currentTextOffset() + 1);
+				advance();
+				m_token = m_containers.back().isObject ? Token::EndObject : Token::EndArray;
+				m_containers.pop_back();
+				return;
+			}
+		}
+	}
+
+	std::size_t depth() const
+	{
+		return m_containers.size();
+	}
+
+	const Any& value() const
+	{
+		return m_value;
+	}
+
+	String& string()
+	{
+		if(m_token != Token::String && m_token != Token::Key)
+			throw TypeError{};
+
+		return m_string;
+	}
+
+	// The json text of the current token
+	std::string_view tokenText() const
+	{
+		return m_text.substr(m_tokenStart, m_tokenEnd - m_tokenStart);
+	}
+
+	std::string_view text() const
+	{
+		return m_text;
+	}
+
+private:
+	struct Container{
+		bool isObject;
+		bool isEmpty;
+	};
+
+	std::vector<Container> m_containers;
+	Token                  m_token = Token::Null;
+	Any                    m_value;
+	String                 m_string;
+	std::size_t            m_tokenStart = 0;
+	std::size_t            m_tokenEnd   = 0;
+	bool                   m_rootRead   = false;
+	bool                   m_keyRead    = false;
+
+	void setTokenText(std::size_t start, std::size_t end)
+	{
+		m_tokenStart = start;
+		m_tokenEnd   = end;
+	}
+
+	Token readKey()
+	{
+		const auto keyStart = atEnd() ? m_text.size() : currentTextOffset();
+		setTokenText(keyStart, parseString(m_string));
+
+		if(atEnd() || currentChar() != ':')
+			throw ParseError{"Expected ':'", atEnd() ? m_text.size() : currentTextOffset()};
+
+		advance();
+		m_keyRead = true;
+		m_value   = nullptr;
+
+		return m_token = Token::Key;
+	}
+
+	Token readValue()
+	{
+		if(atEnd())
+			throw ParseError{"Unexpected end of input", m_text.size()};
+
+		const auto start = currentTextOffset();
+		m_value = nullptr;
+
+		switch(currentChar())
+		{
+		case '{':
+			setTokenText(start, start + 1);
+			advance();
+			m_containers.push_back({true, true});
+			return m_token = Token::StartObject;
+		case '[':
+			setTokenText(start, start + 1);
+			advance();
+			m_containers.push_back({false, true});
+			return m_token = Token::StartArray;
+		case '\"':
+			setTokenText(start, parseString(m_string));
+			return m_token = Token::String;
+		default:
+			break;
+		}
+
+		m_value = parseSimpleValue();
+
+		auto end = start + 1;
+
+		while(end < m_text.size() && !isTokenDelimiter(m_text[end]))
+			++end;
+
+		setTokenText(start, end);
+
+		if(m_value.isNull())
+			return m_token = Token::Null;
+
+		if(m_value.isBoolean())
+			return m_token = Token::Boolean;
+
+		if(m_value.isInteger())
+			return m_token = Token::Integer;
+
+		return m_token = Token::Decimal;
+	}
+};
+
+Reader::Reader(std::string_view text)
+	: m_implementation{std::make_unique<Implementation>(text)}
+{
+}
+
+Reader::Reader(Reader&& other) noexcept = default;
+Reader::~Reader() = default;
+Reader& Reader::operator=(Reader&& other) noexcept = default;
+
+Reader::Token Reader::next()
+{
+	return m_implementation->next();
+}
+
+Reader::Token Reader::token() const
+{
+	return m_implementation->token();
+}
+
+std::size_t Reader::position() const
+{
+	return static_cast<std::size_t>(m_implementation->tokenText().data() - m_implementation->text().data());
+}
+
+void Reader::skip()
+{
+	auto token = m_implementation->token();
+
+	if(token == Token::Key)
+		token = next();
+
+	if(token != Token::StartObject && token != Token::StartArray)
+		return;
+
+	const auto depth = m_implementation->depth();
+
+	while(m_implementation->depth() >= depth)
+		next();
+}
+
+Boolean Reader::boolean() const
+{
+	return m_implementation->value().boolean();
+}
+
+Integer Reader::integer() const
+{
+	return m_implementation->value().integer();
+}
+
+Decimal Reader::decimal() const
+{
+	return m_implementation->value().decimal();
+}
+
+Decimal Reader::number() const
+{
+	return m_implementation->value().number();
+}
+
+const String& Reader::string() const
+{
+	return m_implementation->string();
+}
+
+String& Reader::string()
+{
+	return m_implementation->string();
+}
+
+Any Reader::readValue()
+{
+	Any               result;
+	std::vector<Any*> containers;
+	Any*              value = &result;
+	auto              token = m_implementation->token();
+
+	while(true)
+	{
+		switch(token)
+		{
+		case Token::Null:
+			*value = nullptr;
+			break;
+		case Token::Boolean:
+			*value = boolean();
+			break;
+		case Token::Integer:
+			*value = integer();
+			break;
+		case Token::Decimal:
+			*value = decimal();
+			break;
+		case Token::String:
+			*value = std::move(string());
+			break;
+		case Token::StartObject:
+			*value = Object{};
+			containers.push_back(value);
+			break;
+		case Token::StartArray:
+			*value = Array{};
+			containers.push_back(value);
+			break;
+		default:
+			throw TypeError{"Expected the start of a json value"};
+		}
+
+		if(containers.empty())
+			return result;
+
+		token = next();
+
+		while(true)
+		{
+			// Close all containers that end before the next value
+			while(token == Token::EndObject || token == Token::EndArray)
+			{
+				containers.pop_back();
+
+				if(containers.empty())
+					return result;
+
+				token = next();
+			}
+
+			auto& container = *containers.back();
+
+			// Arrays that start with an integer are packed until they contain something else
+			if(token != Token::Integer || !(container.isIntegerArray() || container.array().empty()))
+				break;
+
+			if(!container.isIntegerArray())
+				container = IntegerArray{};
+
+			auto& integers = container.integerArray();
+
+			do
+			{
+				integers.push_back(integer());
+				token = next();
+			}
+			while(token == Token::Integer);
+		}
+
+		auto& container = *containers.back();
+
+		if(token == Token::Key)
+		{
+			auto [it, inserted] = container.object().try_emplace(Key::plain(std::move(string())));
+
+			if(!inserted)
+			{
+				const auto keyOffset = m_implementation->tokenText().data() - m_implementation->text().data();
+				throw ParseError{"Duplicate key '" + it->first.str() + "'", static_cast<std::size_t>(keyOffset)};
+			}
+
+			value = &it->second;
+			token = next();
+		}
+		else
+		{
+			value = &container.array().emplace_back();
+		}
+	}
+}
+
+std::string_view Reader::rawValue()
+{
+	const auto token = m_implementation->token();
+
+	if(token != Token::Null && token != Token::Boolean && token != Token::Integer && token != Token::Decimal &&
+	   token != Token::String && token != Token::StartObject && token != Token::StartArray)
+	{
+		throw TypeError{"Expected the start of a json value"};
+	}
+
+	const auto text  = m_implementation->text();
+	const auto start = static_cast<std::size_t>(m_implementation->tokenText().data() - text.data());
+	skip();
+	const auto end = m_implementation->tokenText();
+
+	return text.substr(start, static_cast<std::size_t>(end.data() - text.data()) + end.size() - start);
+}
+
+std::string_view Reader::rawValueUnchecked()
+{
+	const auto token = m_implementation->token();
+
+	if(token != Token::Null && token != Token::Boolean && token != Token::Integer && token != Token::Decimal &&
+	   token != Token::String && token != Token::StartObject && token != Token::StartArray)
+	{
+		throw TypeError{"Expected the start of a json value"};
+	}
+
+	const auto text  = m_implementation->text();
+	const auto start = static_cast<std::size_t>(m_implementation->tokenText().data() - text.data());
+	if(token == Token::StartObject || token == Token::StartArray)
+		m_implementation->skipContainer();
+	const auto end = m_implementation->tokenText();
+
+	return text.substr(start, static_cast<std::size_t>(end.data() - text.data()) + end.size() - start);
+}
+
+/*
+ * LazyValue
+ */
+
+LazyValue LazyValue::fromText(std::string_view text, std::shared_ptr<const std::string> source)
+{
+	return LazyValue{text, std::move(source)};
+}
+
+Any& LazyValue::value()
+{
+	if(!m_text.empty())
+	{
+		m_value = parse(m_text);
+		m_text  = {};
+		m_source.reset();
+	}
+
+	return m_value;
+}
+
+LazyValue LazyValue::get(std::string_view key) const
+{
+	if(m_text.empty())
+		return LazyValue{m_value.object().get(key)};
+
+	Reader reader{m_text};
+
+	if(reader.next() != Reader::Token::StartObject)
+		throw TypeError{};
+
+	while(reader.next() == Reader::Token::Key)
+	{
+		const auto found = reader.string() == key;
+		reader.next();
+
+		if(found)
+			return LazyValue{reader.rawValue(), std::shared_ptr{m_source}};
+
+		reader.rawValueUnchecked();
+	}
+
+	throw TypeError{"Missing key '" + std::string{key} + '\''};
+}
+
+Any parse(std::string_view text)
+{
+	Parser parser{text};
+
+	return parser.parse();
+}
+
+Document parseDocument(std::string_view text)
+{
+	// Leaves room for the tree of a typical message without growing the arena
+	Document document{std::max<std::size_t>(text.size() * 2, 1024)};
+	Parser   parser{text, document.allocator()};
+
+	document.root() = parser.parse();
+
+	return document;
+}
+
+void Writer::null()
+{
+	if(m_encoding == Encoding::Cbor)
+	{
+		m_output += static_cast<char>(CborNull);
+		return;
+	}
+
+	writeSeparator();
+	m_output += NullValueString;
+}
+
+void Writer::boolean(Boolean value)
+{
+	if(m_encoding == Encoding::Cbor)
+	{
+		m_output += static_cast<char>(value ? CborTrue : CborFalse);
+		return;
+	}
+
+	writeSeparator();
+	m_output += value ? TrueValueString : FalseValueString;
+}
+
+void Writer::integer(Integer value)
+{
+	if(m_encoding == Encoding::Cbor)
+	{
+		appendCborInteger(m_output, value);
+		return;
+	}
+
+	writeSeparator();
+	appendInteger(m_output, value);
+}
+
+void Writer::decimal(Decimal value)
+{
+	if(m_encoding == Encoding::Cbor)
+	{
+		appendCborDecimal(m_output, value);
+		return;
+	}
+
+	writeSeparator();
+	appendDecimal(m_output, value);
+}
+
+void Writer::integerArray(std::span<const Integer> values)
+{
+	if(m_encoding == Encoding::Cbor)
+	{
+		appendCborIntegers(m_output, values);
+		return;
+	}
+
+	writeSeparator();
+	m_output += '[';
+	appendIntegers(m_output, values);
+	m_output += ']';
+}
+
+void Writer::integerArray(std::span<const std::uint32_t> values)
+{
+	if(m_encoding == Encoding::Cbor)
+	{
+		constexpr auto max = static_cast<std::uint32_t>(std::numeric_limits<Integer>::max());
+
+		if(std::ranges::all_of(values, [](std::uint32_t v){ return v <= max; }))
+		{
+			appendCborIntegers(m_output, values);
+		}
+		else
+		{
+			appendCborHead(m_output, CborArray, values.size());
+
+			for(const auto v : values)
+				appendCborHead(m_output, CborUnsigned, v);
+		}
+
+		return;
+	}
+
+	writeSeparator();
+	m_output += '[';
+	appendIntegers(m_output, values);
+	m_output += ']';
+}
+
+void Writer::string(std::string_view value)
+{
+	if(m_encoding == Encoding::Cbor)
+	{
+		appendCborString(m_output, value);
+		return;
+	}
+
+	writeSeparator();
+	appendStringLiteral(m_output, value);
+}
+
+void Writer::value(const Any& value)
+{
+	if(m_encoding == Encoding::Cbor)
+	{
+		appendCbor(m_output, value);
+		return;
+	}
+
+	writeSeparator();
+	stringifyImplementation(value, m_output, 0, false);
+}
+
+void Writer::startObject()
+{
+	if(m_encoding == Encoding::Cbor)
+	{
+		m_output += static_cast<char>(CborMap | CborIndefinite);
+		return;
+	}
+
+	writeSeparator();
+	m_output += '{';
+	m_needsSeparator = false;
+}
+
+void Writer::key(std::string_view key)
+{
+	if(m_encoding == Encoding::Cbor)
+	{
+		appendCborString(m_output, key);
+		return;
+	}
+
+	writeSeparator();
+	appendStringLiteral(m_output, key);
+	m_output += ':';
+	m_needsSeparator = false;
+}
+
+void Writer::endObject()
+{
+	if(m_encoding == Encoding::Cbor)
+	{
+		m_output += static_cast<char>(CborBreak);
+		return;
+	}
+
+	m_output += '}';
+	m_needsSeparator = true;
+}
+
+void Writer::startArray()
+{
+	if(m_encoding == Encoding::Cbor)
+	{
+		m_output += static_cast<char>(CborArray | CborIndefinite);
+		return;
+	}
+
+	writeSeparator();
+	m_output += '[';
+	m_needsSeparator = false;
+}
+
+void Writer::endArray()
+{
+	if(m_encoding == Encoding::Cbor)
+	{
+		m_output += static_cast<char>(CborBreak);
+		return;
+	}
+
+	m_output += ']';
+	m_needsSeparator = true;
+}
+
+void Writer::writeSeparator()
+{
+	if(m_needsSeparator)
+		m_output += ',';
+
+	m_needsSeparator = true;
+}
+
+std::string stringify(const Any& json, bool format)
+{
+	std::string str;
+	stringifyImplementation(json, str, 0, format);
+	return str;
+}
+
+std::string toCbor(const Any& json)
+{
+	std::string data;
+	appendCbor(data, json);
+	return data;
+}
+
+Any parseCbor(std::string_view data)
+{
+	CborParser parser{data};
+
+	return parser.parse();
+}
+
+Document parseCborDocument(std::string_view data)
+{
+	Document   document{std::max<std::size_t>(data.size() * 2, 1024)};
+	CborParser parser{data, document.allocator()};
+
+	document.root() = parser.parse();
+
+	return document;
+}
+
+std::string toStringLiteral(std::string_view str)
+{
+	std::string result;
+	result.reserve(str.size() + 2);
+	appendStringLiteral(result, str);
+
+	return result;
+}
+
+std::string fromStringLiteral(std::string_view str)
+{
+	if(str.size() > 0 && str.front() == '\"')
+		str.remove_prefix(1);
+
+	if(str.size() > 0 && str.back() == '\"')
+		str.remove_suffix(1);
+
+	std::string result;
+	appendUnescaped(result, str);
 
 	return result;
 }
@@ -1,11 +1,15 @@
 #pragma once
 
+#include <atomic>
+#include <memory>
+#include <span>
 #include <string>
 #include <vector>
 #include <cstdint>
-#include <variant>
+#include <concepts>
 #include <string_view>
-#include <lsp/strmap.h>
+#include <initializer_list>
+#include <memory_resource>
 #include <lsp/exception.h>
 
 namespace lsp::json{
@@ -21,7 +25,20 @@ using Boolean = bool;
 using Decimal = double;
 using Integer = std::int32_t;
 using String  = std::string;
-using Array   = std::vector<Any>;
+using Array   = std::pmr::vector<Any>;
+
+/*
+ * Arrays that only contain integers are stored packed. They still are arrays and
+ * array() can be used to access them like any other, see Any.
+ */
+using IntegerArray = std::pmr::vector<Integer>;
+
+/*
+ * Objects and arrays take their memory from a std::pmr::memory_resource.
+ * Values created by the user or copied use the default resource while a
+ * json::Document uses its own arena for the whole tree.
+ */
+using Allocator = std::pmr::polymorphic_allocator<std::byte>;
 
 /*
  * Errors
@@ -50,96 +67,597 @@ private:
 };
 
 /*
- * Object
+ * Key
+ *
+ * Object keys. Keys created with Key::intern share an atom from a global table
+ * so comparing two of them is a pointer comparison and their hash is computed
+ * only once. Any other key that matches an interned name picks up its atom but
+ * never adds one, which keeps the table limited to names used by the program.
+ * The parsers create plain keys that skip the lookup, since most parsed objects
+ * are never searched. Searching them with an atom still works but compares text.
  */
 
-using ObjectMap = StrMap<String, Any>;
-class Object : public ObjectMap{
+struct KeyAtom{
+	String      text;
+	std::size_t hash;
+};
+
+class Key;
+
+template<typename T>
+concept KeyString = std::convertible_to<const T&, std::string_view> && !std::same_as<T, Key>;
+
+class Key{
 public:
-	using ObjectMap::ObjectMap;
+	Key() = default;
+	Key(const char* str) : Key{std::string_view{str}}{}
+	Key(std::string_view str);
+	Key(const String& str) : Key{std::string_view{str}}{}
+	Key(String&& str);
+
+	static Key intern(std::string_view str);
+	// Doesn't look up an atom
+	static Key plain(String&& str);
+
+	bool isAtom() const noexcept{ return m_atom != nullptr; }
+	const String& str() const noexcept{ return m_atom ? m_atom->text : m_text; }
+	std::size_t hash() const noexcept{ return m_atom ? m_atom->hash : hashString(m_text); }
+
+	// FNV-1a, cheaper than std::hash for the short strings used as keys
+	static std::size_t hashString(std::string_view str) noexcept
+	{
+		std::uint64_t hash = 14695981039346656037u;
+
+		for(const char c : str)
+		{
+			hash ^= static_cast<unsigned char>(c);
+			hash *= 1099511628211u;
+		}
+
+		return static_cast<std::size_t>(hash);
+	}
+
+	operator const String&() const noexcept{ return str(); }
+	operator std::string_view() const noexcept{ return str(); }
+
+	bool operator==(const Key& other) const noexcept
+	{
+		if(m_atom && other.m_atom)
+			return m_atom == other.m_atom;
+
+		return str() == other.str();
+	}
+
+	template<KeyString T>
+	bool operator==(const T& other) const noexcept
+	{
+		return str() == std::string_view{other};
+	}
+
+private:
+	const KeyAtom* m_atom = nullptr;
+	String         m_text;
+
+	explicit Key(const KeyAtom* atom) : m_atom{atom}{}
+};
+
+/*
+ * Object
+ *
+ * Most objects only have a handful of keys so they are stored as a flat vector
+ * of key/value pairs in insertion order and looked up with a linear scan. Once an
+ * object grows beyond LinearScanLimit keys a hash index into the vector is built
+ * on top. Inserting invalidates iterators and references to other values.
+ */
 
+class Object{
+public:
+	using key_type        = Key;
+	using mapped_type     = Any;
+	using value_type      = std::pair<Key, Any>;
+	using size_type       = std::size_t;
+	using allocator_type  = Allocator;
+	using iterator        = std::pmr::vector<value_type>::iterator;
+	using const_iterator  = std::pmr::vector<value_type>::const_iterator;
+
+	static constexpr std::size_t LinearScanLimit = 8;
+
+	Object() = default;
+	explicit Object(const Allocator& allocator) : m_entries(allocator), m_index(allocator){}
+	Object(std::initializer_list<value_type> init, const Allocator& allocator = {});
+	Object(const Object& other) = default;
+	Object(Object&& other) = default;
+	Object(const Object& other, const Allocator& allocator);
+	Object(Object&& other, const Allocator& allocator);
+
+	Object& operator=(const Object& other) = default;
+	Object& operator=(Object&& other) = default;
+
+	allocator_type get_allocator() const noexcept{ return m_entries.get_allocator(); }
+
+	iterator begin() noexcept{ return m_entries.begin(); }
+	iterator end() noexcept{ return m_entries.end(); }
+	const_iterator begin() const noexcept{ return m_entries.begin(); }
+	const_iterator end() const noexcept{ return m_entries.end(); }
+	const_iterator cbegin() const noexcept{ return m_entries.cbegin(); }
+	const_iterator cend() const noexcept{ return m_entries.cend(); }
+
+	bool empty() const noexcept{ return m_entries.empty(); }
+	std::size_t size() const noexcept;
+	void reserve(std::size_t size){ m_entries.reserve(size); }
+	void clear() noexcept;
+
+	iterator find(const Key& key);
+	const_iterator find(const Key& key) const;
+	bool contains(const Key& key) const;
+	std::size_t count(const Key& key) const{ return contains(key) ? 1 : 0; }
+
+	template<KeyString K>
+	iterator find(const K& key);
+	template<KeyString K>
+	const_iterator find(const K& key) const;
+	template<KeyString K>
+	bool contains(const K& key) const;
+	template<KeyString K>
+	std::size_t count(const K& key) const{ return contains(key) ? 1 : 0; }
+
+	Any& get(const Key& key);
+	const Any& get(const Key& key) const;
 	Any& get(std::string_view key);
 	const Any& get(std::string_view key) const;
+	Any& get(const char* key){ return get(std::string_view{key}); }
+	const Any& get(const char* key) const{ return get(std::string_view{key}); }
+	Any& get(const String& key){ return get(std::string_view{key}); }
+	const Any& get(const String& key) const{ return get(std::string_view{key}); }
+
+	template<typename K>
+	Any& operator[](K&& key)
+	{
+		return try_emplace(std::forward<K>(key)).first->second;
+	}
+
+	template<typename K, typename... Args>
+	std::pair<iterator, bool> try_emplace(K&& key, Args&&... args);
+
+	template<typename K, typename V>
+	std::pair<iterator, bool> emplace(K&& key, V&& value)
+	{
+		return try_emplace(std::forward<K>(key), std::forward<V>(value));
+	}
+
+	iterator erase(const_iterator pos);
+	std::size_t erase(const Key& key);
+
+	bool operator==(const Object& other) const;
+
+private:
+	std::pmr::vector<value_type>    m_entries;
+	std::pmr::vector<std::uint32_t> m_index; // Open addressing, stores entry index + 1 and 0 for empty slots
+
+	std::size_t indexOf(const Key& key) const;
+	std::size_t indexOf(std::string_view key) const;
+	void indexLastEntry();
+	void rebuildIndex();
 };
 
 /*
  * Any
  */
 
-using AnyVariant = std::variant<Null, Boolean, Integer, Decimal, String, Object, Array>;
-class Any : private AnyVariant{
-	using AnyVariant::AnyVariant;
+/*
+ * Scalars are stored inline next to a type tag while strings, objects and arrays
+ * live in a separate allocation that the value points to. This keeps Any at 16
+ * bytes which matters for large arrays of numbers.
+ * Strings, objects and arrays are allocated from the allocator passed to the
+ * allocator extended constructors. Objects and arrays that are moved in without
+ * one keep their own allocator and everything else uses the default resource.
+ *
+ * The parser stores arrays of integers as an IntegerArray. isArray() is true for
+ * those as well. Calling the non-const array() converts the value into a regular
+ * Array while the const version creates the Array once and keeps it alongside the
+ * packed integers until the value is destroyed. That costs a full Any per integer,
+ * so code that only reads should check isIntegerArray() and use integerArray()
+ * instead. The non-const integerArray() discards the unpacked Array since the
+ * integers may change, which invalidates references returned by the const array().
+ *
+ * Any::share turns a string, object or array into an immutable value that all of its
+ * copies refer to, e.g. for a large result that is sent more than once. Copying it only
+ * increments a reference count. The non-const accessors give a shared value its own copy
+ * first so changing it never affects the others.
+ */
+
+class Any{
 public:
-	Any() : AnyVariant{nullptr}{}
-
-	bool isNull() const{ return std::holds_alternative<Null>(*this); }
-	bool isBoolean() const{ return std::holds_alternative<Boolean>(*this); }
-	bool isInteger() const{ return std::holds_alternative<Integer>(*this); }
-	bool isDecimal() const{ return std::holds_alternative<Decimal>(*this); }
-	bool isNumber() const{ return isInteger() || isDecimal(); }
-	bool isString() const{ return std::holds_alternative<String>(*this); }
-	bool isObject() const{ return std::holds_alternative<Object>(*this); }
-	bool isArray() const{ return std::holds_alternative<Array>(*this); }
-
-	Boolean boolean() const{ return get<Boolean>(); }
-	Integer integer() const{ return get<Integer>(); }
-	Decimal decimal() const{ return get<Decimal>(); }
-	const String& string() const{ return get<String>(); }
-	String& string(){ return get<String>(); }
-	const Object& object() const{ return get<Object>(); }
-	Object& object(){ return get<Object>(); }
-	const Array& array() const{ return get<Array>(); }
-	Array& array(){ return get<Array>(); }
+	using allocator_type = Allocator;
+
+	Any() noexcept : m_bits{0}, m_type{Type::Null}{}
+	Any(Null) noexcept : m_bits{0}, m_type{Type::Null}{}
+	Any(Integer value) noexcept : m_bits{0}, m_type{Type::Integer}{ m_integer = value; }
+	Any(Decimal value) noexcept : m_decimal{value}, m_type{Type::Decimal}{}
+	Any(const char* value) : Any{String{value}}{}
+	Any(const String& value) : Any{String{value}}{}
+	Any(String&& value) : m_string{newString(Allocator{}, std::move(value))}, m_type{Type::String}{}
+	Any(const Object& value);
+	Any(Object&& value);
+	Any(const Array& value);
+	Any(Array&& value);
+	Any(const IntegerArray& value);
+	Any(IntegerArray&& value);
+
+	// Only actual booleans, pointers should not silently turn into one
+	template<std::same_as<Boolean> T>
+	Any(T value) noexcept : m_bits{0}, m_type{Type::Boolean}{ m_boolean = value; }
+
+	/*
+	 * Allocator extended constructors used by the containers. Strings, objects and
+	 * arrays are moved if they already use the given allocator and copied otherwise.
+	 */
+	Any(std::allocator_arg_t, const Allocator&) noexcept : m_bits{0}, m_type{Type::Null}{}
+	Any(std::allocator_arg_t, const Allocator& allocator, const Any& other);
+	Any(std::allocator_arg_t, const Allocator& allocator, Any&& other);
+	template<std::same_as<String> T>
+	Any(std::allocator_arg_t, const Allocator& allocator, T&& value) : m_string{newString(allocator, std::move(value))}, m_type{Type::String}{}
+
+	Any(const Any& other) : Any{std::allocator_arg, Allocator{}, other}{}
+	Any(Any&& other) noexcept : m_bits{other.m_bits}, m_type{other.m_type}{ other.m_type = Type::Null; }
+	~Any(){ reset(); }
+
+	Any& operator=(const Any& other);
+	Any& operator=(Any&& other) noexcept;
+
+	static Any share(Any&& value);
+
+	bool isNull() const noexcept{ return m_type == Type::Null; }
+	bool isBoolean() const noexcept{ return m_type == Type::Boolean; }
+	bool isInteger() const noexcept{ return m_type == Type::Integer; }
+	bool isDecimal() const noexcept{ return m_type == Type::Decimal; }
+	bool isNumber() const noexcept{ return isInteger() || isDecimal(); }
+	bool isString() const noexcept{ return target().m_type == Type::String; }
+	bool isObject() const noexcept{ return target().m_type == Type::Object; }
+	bool isArray() const noexcept{ return target().m_type == Type::Array || target().m_type == Type::IntegerArray; }
+	bool isIntegerArray() const noexcept{ return target().m_type == Type::IntegerArray; }
+	bool isShared() const noexcept{ return m_type == Type::Shared; }
+
+	Boolean boolean() const{ expect(Type::Boolean); return m_boolean; }
+	Integer integer() const{ expect(Type::Integer); return m_integer; }
+	Decimal decimal() const{ expect(Type::Decimal); return m_decimal; }
+	const String& string() const{ const auto& value = target(); value.expect(Type::String); return value.m_string->value; }
+	String& string(){ unshare(); expect(Type::String); return m_string->value; }
+	const Object& object() const{ const auto& value = target(); value.expect(Type::Object); return *value.m_object; }
+	Object& object(){ unshare(); expect(Type::Object); return *m_object; }
+	const Array& array() const{ const auto& value = target(); return value.m_type == Type::Array ? *value.m_array : value.unpackedIntegers(); }
+	Array& array(){ unshare(); if(m_type != Type::Array) unpackIntegers(); return *m_array; }
+	const IntegerArray& integerArray() const{ const auto& value = target(); value.expect(Type::IntegerArray); return value.m_integers->values; }
+	IntegerArray& integerArray();
 
 	Decimal number() const
 	{
 		if(isDecimal())
-			return get<Decimal>();
+			return m_decimal;
 
 		if(isInteger())
-			return static_cast<Decimal>(get<Integer>());
+			return static_cast<Decimal>(m_integer);
 
 		throw TypeError{};
 	}
 
-	bool operator==(const Any& other) const
-	{
-		return static_cast<const AnyVariant&>(*this) == other;
-	}
+	bool operator==(const Any& other) const;
 
 	bool operator!=(const Any& other) const
 	{
-		return static_cast<const AnyVariant&>(*this) != other;
+		return !(*this == other);
 	}
 
 private:
-	template<typename T>
-	T& get()
+	enum class Type : std::uint8_t{
+		Null,
+		Boolean,
+		Integer,
+		Decimal,
+		String,
+		Object,
+		Array,
+		IntegerArray,
+		Shared
+	};
+
+	struct StringBox{
+		String                     value;
+		std::pmr::memory_resource* resource;
+	};
+
+	struct IntegerArrayBox{
+		IntegerArray        values;
+		std::atomic<Array*> unpacked; // Created on demand by the const array()
+	};
+
+	struct SharedBox;
+
+	union{
+		std::uint64_t    m_bits; // Used to copy whichever member is active
+		Boolean          m_boolean;
+		Integer          m_integer;
+		Decimal          m_decimal;
+		StringBox*       m_string;
+		Object*          m_object;
+		Array*           m_array;
+		IntegerArrayBox* m_integers;
+		SharedBox*       m_shared;
+	};
+	Type             m_type;
+
+	void expect(Type type) const
 	{
-		if(std::holds_alternative<T>(*this))
-			return std::get<T>(*this);
-
-		throw TypeError{};
+		if(m_type != type)
+			throw TypeError{};
 	}
 
-	Any& get()
+	void reset() noexcept
 	{
-		return *this;
+		if(m_type >= Type::String)
+			release();
 	}
 
-	template<typename T>
-	const T& get() const
-	{
-		if(std::holds_alternative<T>(*this))
-			return std::get<T>(*this);
-
-		throw TypeError{};
-	}
+	// The value that a shared value refers to or the value itself
+	const Any& target() const noexcept;
 
-	const Any& get() const
+	void unshare()
 	{
-		return *this;
+		if(m_type == Type::Shared)
+			copySharedValue();
 	}
+
+	void copySharedValue();
+
+	void release() noexcept;
+	const Array& unpackedIntegers() const;
+	void unpackIntegers();
+
+	static StringBox* newString(const Allocator& allocator, String&& value);
+	static IntegerArrayBox* newIntegers(const Allocator& allocator, IntegerArray&& values);
+	static void deleteIntegers(IntegerArrayBox* integers) noexcept;
+};
+
+struct Any::SharedBox{
+	std::atomic<std::size_t> references;
+	Any                      value;
+};
+
+inline const Any& Any::target() const noexcept
+{
+	return m_type == Type::Shared ? m_shared->value : *this;
+}
+
+/*
+ * Object lookup, defined here because it needs the complete Any type
+ */
+
+inline std::size_t Object::size() const noexcept
+{
+	return m_entries.size();
+}
+
+inline Object::iterator Object::find(const Key& key)
+{
+	return begin() + static_cast<std::ptrdiff_t>(indexOf(key));
+}
+
+inline Object::const_iterator Object::find(const Key& key) const
+{
+	return begin() + static_cast<std::ptrdiff_t>(indexOf(key));
+}
+
+inline bool Object::contains(const Key& key) const
+{
+	return indexOf(key) != m_entries.size();
+}
+
+template<KeyString K>
+Object::iterator Object::find(const K& key)
+{
+	return begin() + static_cast<std::ptrdiff_t>(indexOf(std::string_view{key}));
+}
+
+template<KeyString K>
+Object::const_iterator Object::find(const K& key) const
+{
+	return begin() + static_cast<std::ptrdiff_t>(indexOf(std::string_view{key}));
+}
+
+template<KeyString K>
+bool Object::contains(const K& key) const
+{
+	return indexOf(std::string_view{key}) != m_entries.size();
+}
+
+template<typename K, typename... Args>
+std::pair<Object::iterator, bool> Object::try_emplace(K&& key, Args&&... args)
+{
+	Key objectKey{std::forward<K>(key)};
+
+	if(const auto it = find(objectKey); it != end())
+		return {it, false};
+
+	m_entries.emplace_back(std::piecewise_construct,
+	                       std::forward_as_tuple(std::move(objectKey)),
+	                       std::forward_as_tuple(std::forward<Args>(args)...));
+	indexLastEntry();
+
+	return {std::prev(end()), true};
+}
+
+/*
+ * Document
+ *
+ * Owns a json value together with a monotonic arena that all of its objects and
+ * arrays are allocated from. Destroying the document releases the arena as a
+ * whole. Values that should outlive the document have to be copied or moved
+ * into an Any using a different allocator, e.g. with fromJson.
+ */
+
+class Document{
+public:
+	explicit Document(std::size_t initialArenaSize = 0);
+	Document(Document&& other) = default;
+
+	Document& operator=(Document&& other);
+
+	Allocator allocator() const{ return Allocator{m_arena.get()}; }
+
+	Any& root(){ return m_root; }
+	const Any& root() const{ return m_root; }
+
+private:
+	std::unique_ptr<std::pmr::monotonic_buffer_resource> m_arena;
+	Any                                                  m_root;
+};
+
+/*
+ * Reader
+ *
+ * Pull parser that reads json text one token at a time without building a value.
+ * Only the current token is kept in memory which allows processing large arrays
+ * element by element. Unlike parse it does not detect duplicate object keys.
+ */
+
+class Reader{
+public:
+	enum class Token{
+		Null,
+		Boolean,
+		Integer,
+		Decimal,
+		String,
+		StartObject,
+		Key,
+		EndObject,
+		StartArray,
+		EndArray,
+		End
+	};
+
+	explicit Reader(std::string_view text);
+	Reader(Reader&& other) noexcept;
+	~Reader();
+
+	Reader& operator=(Reader&& other) noexcept;
+
+	// Reads the next token. Returns Token::End once the whole text has been read.
+	Token next();
+	Token token() const;
+	// Offset of the current token in the text
+	std::size_t position() const;
+
+	// Skips the current value or the value following the current key
+	void skip();
+
+	Boolean boolean() const;
+	Integer integer() const;
+	Decimal decimal() const;
+	Decimal number() const;
+	// The current string value or key
+	const String& string() const;
+	String& string();
+
+	// Reads the value that starts at the current token and leaves the reader at its last token
+	Any readValue();
+	// Like readValue but returns the json text of the value without parsing it
+	std::string_view rawValue();
+	// Like rawValue but only matches brackets to find the end of the value. What is in between is not validated.
+	std::string_view rawValueUnchecked();
+
+private:
+	class Implementation;
+	std::unique_ptr<Implementation> m_implementation;
+};
+
+/*
+ * LazyValue
+ *
+ * Json value that is kept as text until it is accessed for the first time, e.g. the params of a
+ * message that might never be read. The text is only validated once it is parsed. The value keeps
+ * the source alive if one is given, otherwise the text has to outlive the value until then.
+ * Members of an object that was not parsed yet can be accessed with get without parsing the others.
+ */
+
+class LazyValue{
+public:
+	LazyValue() = default;
+	LazyValue(Any&& value) noexcept : m_value{std::move(value)}{}
+	LazyValue(const Any& value) : m_value{value}{}
+
+	static LazyValue fromText(std::string_view text, std::shared_ptr<const std::string> source = {});
+
+	bool isParsed() const noexcept{ return m_text.empty(); }
+	// The json text of the value, empty once it has been parsed
+	std::string_view text() const noexcept{ return m_text; }
+
+	// Parses the text on first access
+	Any& value();
+	Any take(){ return std::move(value()); }
+
+	// The value of the member of an object or TypeError if there is none.
+	// The member of an unparsed object is returned unparsed as well and no other members are parsed.
+	LazyValue get(std::string_view key) const;
+
+private:
+	std::shared_ptr<const std::string> m_source;
+	std::string_view                   m_text;
+	Any                                m_value;
+
+	LazyValue(std::string_view text, std::shared_ptr<const std::string>&& source)
+		: m_source{std::move(source)}
+		, m_text{text}{}
+};
+
+/*
+ * Encoding
+ *
+ * Values can be written as json text or as CBOR (RFC 8949), a binary encoding for
+ * peers that both support it.
+ */
+
+enum class Encoding : std::uint8_t{
+	Json,
+	Cbor
+};
+
+/*
+ * Writer
+ *
+ * Appends the json text of values written one at a time to a string without building a value first.
+ * The output is the same as the one of stringify without formatting or of toCbor with Encoding::Cbor.
+ */
+
+class Writer{
+public:
+	explicit Writer(std::string& output, Encoding encoding = Encoding::Json)
+		: m_output{output}
+		, m_encoding{encoding}{}
+
+	void null();
+	void boolean(Boolean value);
+	void integer(Integer value);
+	void decimal(Decimal value);
+	void string(std::string_view value);
+	void value(const Any& value);
+
+	// Writes a whole array at once, unsigned values outside of the Integer range are written as decimals
+	void integerArray(std::span<const Integer> values);
+	void integerArray(std::span<const std::uint32_t> values);
+
+	void startObject();
+	void key(std::string_view key);
+	void endObject();
+	void startArray();
+	void endArray();
+
+private:
+	std::string& m_output;
+	Encoding     m_encoding;
+	bool         m_needsSeparator = false;
+
+	void writeSeparator();
 };
 
 /*
@@ -147,8 +665,21 @@ private:
  */
 
 Any         parse(std::string_view text);
+Document    parseDocument(std::string_view text);
 std::string stringify(const Any& json, bool format = false);
 std::string toStringLiteral(std::string_view str);
 std::string fromStringLiteral(std::string_view str);
 
+/*
+ * CBOR
+ *
+ * The parsed value is the same as the one of the json text of the encoded value. Arrays of
+ * integers are encoded as typed arrays (RFC 8746) and integers outside of the Integer range
+ * are read as decimals. Other tags, byte strings and simple values are not supported.
+ */
+
+std::string toCbor(const Any& json);
+Any         parseCbor(std::string_view data);
+Document    parseCborDocument(std::string_view data);
+
 } // namespace lsp::json
@@ -6,14 +6,32 @@
 namespace lsp::jsonrpc{
 namespace{
 
-constexpr std::string_view ProtocolVersion{"2.0"};
+/*
+ * Message keys
+ */
+
+namespace keys{
+
+const json::Key jsonrpc = json::Key::intern("jsonrpc");
+const json::Key id      = json::Key::intern("id");
+const json::Key method  = json::Key::intern("method");
+const json::Key params  = json::Key::intern("params");
+const json::Key result  = json::Key::intern("result");
+const json::Key error   = json::Key::intern("error");
+const json::Key code    = json::Key::intern("code");
+const json::Key message = json::Key::intern("message");
+const json::Key data    = json::Key::intern("data");
+
+} // namespace keys
 
 void verifyProtocolVersion(const json::Object& json)
 {
-	if(!json.contains("jsonrpc"))
+	const auto it = json.find(keys::jsonrpc);
+
+	if(it == json.end())
 		throw ProtocolError{"jsonrpc property is missing"};
 
-	const auto& jsonrpc = json.get("jsonrpc");
+	const auto& jsonrpc = it->second;
 
 	if(!jsonrpc.isString())
 		throw ProtocolError{"jsonrpc property expected to be a string"};
@@ -41,21 +59,19 @@ Request requestFromJson(json::Object& json)
 	verifyProtocolVersion(json);
 
 	Request request;
-	request.method = std::move(json.get("method").string());
+	request.method = std::move(json.get(keys::method).string());
 
-	if(json.contains("id"))
-		request.id = messageIdFromJson(json.get("id"));
+	if(const auto it = json.find(keys::id); it != json.end())
+		request.id = messageIdFromJson(it->second);
 
-	if(json.contains("params"))
+	if(const auto it = json.find(keys::params); it != json.end())
 	{
-		auto& params = json.get("params");
+		auto& params = it->second;
 
-		if(params.isObject())
-			request.params = std::move(params.object());
-		else if(params.isArray())
-			request.params = std::move(params.array());
-		else
+		if(!params.isObject() && !params.isArray())
 			throw ProtocolError{"Params type must be object or array"};
+
+		request.params = std::move(params);
 	}
 
 	return request;
@@ -67,40 +83,43 @@ Response responseFromJson(json::Object& json)
 
 	Response response;
 
-	if(json.contains("id"))
-		response.id = messageIdFromJson(json.get("id"));
+	if(const auto it = json.find(keys::id); it != json.end())
+		response.id = messageIdFromJson(it->second);
 
-	if(json.contains("result"))
-		response.result = std::move(json.get("result"));
+	if(const auto it = json.find(keys::result); it != json.end())
+		response.result = std::move(it->second);
 
-	if(json.contains("error"))
+	if(const auto it = json.find(keys::error); it != json.end())
 	{
-		auto& error = json.get("error");
-		auto& errorObj = error.object();
+		auto& errorObj = it->second.object();
 		auto& responseError = response.error.emplace();
+		const auto codeIt = errorObj.find(keys::code);
 
-		if(!errorObj.contains("code"))
+		if(codeIt == errorObj.end())
 			throw ProtocolError{"Response error is missing the error code"};
 
-		const auto& errorCode = errorObj.get("code");
+		const auto& errorCode = codeIt->second;
 
 		if(!errorCode.isNumber())
 			throw ProtocolError{"Response error code must be a number"};
 
 		responseError.code = static_cast<json::Integer>(errorCode.number());
 
-		if(!errorObj.contains("message"))
+		const auto messageIt = errorObj.find(keys::message);
+
+		if(messageIt == errorObj.end())
 			throw ProtocolError{"Response error is missing the error message"};
 
-		auto& errorMessage = errorObj.get("message");
+		auto& errorMessage = messageIt->second;
 
 		if(!errorMessage.isString())
 			throw ProtocolError{"Response error message must be a string"};
 
 		responseError.message = std::move(errorMessage.string());
 
-		if(errorObj.contains("data"))
-			responseError.data = errorObj.get("data");
+		// Only copied if it lives in the arena of a document since the error can outlive it
+		if(const auto dataIt = errorObj.find(keys::data); dataIt != errorObj.end())
+			responseError.data.emplace(std::allocator_arg, json::Allocator{}, std::move(dataIt->second));
 	}
 
 	if((response.result.has_value() && response.error.has_value()) || (!response.result.has_value() && !response.error.has_value()))
@@ -113,12 +132,121 @@ Response responseFromJson(json::Object& json)
 
 std::variant<Request, Response> messageFromJson(json::Object&& json)
 {
-	if(json.contains("method"))
+	if(json.contains(keys::method))
 		return requestFromJson(json);
 
 	return responseFromJson(json);
 }
 
+std::optional<MessageEnvelope> messageEnvelopeFromJson(std::string_view text, const MethodFilter& isMethodHandled)
+{
+	using Token = json::Reader::Token;
+
+	json::Reader reader{text};
+
+	if(reader.next() != Token::StartObject)
+		return std::nullopt;
+
+	MessageEnvelope envelope;
+	bool            hasJsonrpc = false;
+	bool            hasMethod  = false;
+	bool            hasParams  = false;
+	bool            hasResult  = false;
+
+	while(reader.next() == Token::Key)
+	{
+		const auto& key = reader.string();
+
+		if(key == "jsonrpc" && !hasJsonrpc)
+		{
+			hasJsonrpc = true;
+
+			if(reader.next() != Token::String)
+				throw ProtocolError{"jsonrpc property expected to be a string"};
+
+			if(reader.string() != ProtocolVersion)
+				throw ProtocolError{"Invalid or unsupported jsonrpc version"};
+		}
+		else if(key == "id" && !envelope.id.has_value())
+		{
+			switch(reader.next())
+			{
+			case Token::String:
+				envelope.id = std::move(reader.string());
+				break;
+			case Token::Integer:
+			case Token::Decimal:
+				envelope.id = static_cast<json::Integer>(reader.number());
+				break;
+			case Token::Null:
+				envelope.id = nullptr;
+				break;
+			default:
+				throw ProtocolError{"Request id type must be string, number or null"};
+			}
+		}
+		else if(key == "method" && !hasMethod)
+		{
+			hasMethod = true;
+
+			if(reader.next() != Token::String)
+				throw json::TypeError{};
+
+			envelope.method = std::move(reader.string());
+		}
+		else if(key == "params" && !hasParams)
+		{
+			// Only the end is found for now since the method can follow the params
+			hasParams = true;
+			reader.next();
+			envelope.params = reader.rawValueUnchecked();
+		}
+		else if(key == "result" && !hasResult)
+		{
+			hasResult = true;
+			reader.next();
+			envelope.result = reader.rawValue();
+		}
+		else if(key == "error" || key == "jsonrpc" || key == "id" || key == "method" || key == "params" || key == "result")
+		{
+			// Error responses and duplicate keys are handled by messageFromJson
+			return std::nullopt;
+		}
+		else
+		{
+			reader.skip();
+		}
+	}
+
+	// Makes sure there is nothing but whitespace after the message
+	reader.next();
+
+	if(!hasJsonrpc)
+		throw ProtocolError{"jsonrpc property is missing"};
+
+	// Params that nothing is going to read are dropped.
+	// The others are validated while the handler reads them.
+	if(hasParams && hasMethod && isMethodHandled && !isMethodHandled(envelope.method))
+		envelope.params = {};
+	else if(hasParams && envelope.params.front() != '{' && envelope.params.front() != '[')
+		throw ProtocolError{"Params type must be object or array"};
+
+	// An empty method name can't be used to tell requests and responses apart
+	if(hasMethod && envelope.method.empty())
+		return std::nullopt;
+
+	if(!hasMethod)
+	{
+		if(!hasResult)
+			throw ProtocolError{"Response must have either 'result' or 'error'"};
+
+		if(!envelope.id.has_value())
+			envelope.id = MessageId{};
+	}
+
+	return envelope;
+}
+
 std::variant<RequestBatch, ResponseBatch> messageBatchFromJson(json::Array&& json)
 {
 	if(json.empty())
@@ -150,15 +278,15 @@ json::Object requestToJson(Request&& request)
 {
 	json::Object json;
 
-	json["jsonrpc"] = std::string{ProtocolVersion};
+	json[keys::jsonrpc] = std::string{ProtocolVersion};
 
 	if(request.id.has_value())
-		std::visit([&json](const auto& v){ json["id"] = std::move(v); }, *request.id);
+		std::visit([&json](const auto& v){ json[keys::id] = std::move(v); }, *request.id);
 
-	json["method"] = std::move(request.method);
+	json[keys::method] = std::move(request.method);
 
 	if(request.params.has_value())
-		json["params"] = std::move(*request.params);
+		json[keys::params] = request.params->take();
 
 	return json;
 }
@@ -168,24 +296,24 @@ json::Object responseToJson(Response&& response)
 	assert(response.result.has_value() != response.error.has_value());
 
 	json::Object json;
-	json["jsonrpc"] = std::string{ProtocolVersion};
-	std::visit([&json](const auto& v){ json["id"] = std::move(v); }, response.id);
+	json[keys::jsonrpc] = std::string{ProtocolVersion};
+	std::visit([&json](const auto& v){ json[keys::id] = std::move(v); }, response.id);
 
 	if(response.result.has_value())
-		json["result"] = std::move(*response.result);
+		json[keys::result] = response.result->take();
 
 	if(response.error.has_value())
 	{
 		auto& responseError = *response.error;
 		json::Object errorJson;
 
-		errorJson["code"] = responseError.code;
-		errorJson["message"] = std::move(responseError.message);
+		errorJson[keys::code] = responseError.code;
+		errorJson[keys::message] = std::move(responseError.message);
 
 		if(responseError.data.has_value())
-			json["data"] = std::move(*responseError.data);
+			errorJson[keys::data] = std::move(*responseError.data);
 
-		json["error"] = std::move(errorJson);
+		json[keys::error] = std::move(errorJson);
 	}
 
 	return json;
@@ -1,7 +1,9 @@
 #pragma once
 
 #include <string>
+#include <functional>
 #include <vector>
+#include <string_view>
 #include <variant>
 #include <optional>
 #include <lsp/exception.h>
@@ -9,16 +11,23 @@
 
 namespace lsp::jsonrpc{
 
+inline constexpr std::string_view ProtocolVersion{"2.0"};
+
 using MessageId = std::variant<json::String, json::Integer, json::Null>;
 
 /*
  * Request
  */
 
+/*
+ * Params and result are json::LazyValue so that messages which are never processed,
+ * e.g. because they were cancelled, don't need to parse them.
+ */
+
 struct Request{
-	std::optional<MessageId> id     = {};
-	std::string              method;
-	std::optional<json::Any> params = {};
+	std::optional<MessageId>       id     = {};
+	std::string                    method;
+	std::optional<json::LazyValue> params = {};
 
 	bool isNotification() const{ return !id.has_value(); }
 };
@@ -47,14 +56,29 @@ struct Error{
  */
 
 struct Response{
-	MessageId                id;
-	std::optional<json::Any> result = {};
-	std::optional<Error>     error  = {};
+	MessageId                      id;
+	std::optional<json::LazyValue> result = {};
+	std::optional<Error>           error  = {};
 };
 
 using ResponseBatch = std::vector<Response>;
 using SingleResponseOrBatch = std::variant<Response, ResponseBatch>;
 
+/*
+ * MessageEnvelope
+ * The members of a single request or result response with the params or result left as unparsed json text.
+ * The text is owned by the message content that was scanned.
+ */
+
+struct MessageEnvelope{
+	std::optional<MessageId> id     = {};
+	std::string              method;
+	std::string_view         params;
+	std::string_view         result;
+
+	bool isRequest() const{ return !method.empty(); }
+};
+
 /*
  * Error thrown when a message has an invalid structure
  */
@@ -71,6 +95,13 @@ public:
 std::variant<Request, Response>           messageFromJson(json::Object&& json);
 std::variant<RequestBatch, ResponseBatch> messageBatchFromJson(json::Array&& json);
 
+// Scans the message text without parsing params or result.
+// Returns std::nullopt for batches, error responses and other messages that need to be parsed with messageFromJson.
+// Params are not validated, reading them throws json::ParseError if they are malformed.
+// If isMethodHandled returns false for the method the params are left empty, no matter if they come before or after the method.
+using MethodFilter = std::function<bool(std::string_view method)>;
+std::optional<MessageEnvelope> messageEnvelopeFromJson(std::string_view text, const MethodFilter& isMethodHandled = {});
+
 json::Object requestToJson(Request&& request);
 json::Object responseToJson(Response&& response);
 json::Array  requestBatchToJson(RequestBatch&& batch);
@@ -4,8 +4,9 @@
 namespace lsp{
 namespace{
 
-thread_local const MessageId* t_currentRequestId  = nullptr;
-constexpr          MessageId  NullMessageId       = json::Null(); // Used for notifications which don't have an id
+thread_local const MessageId* t_currentRequestId   = nullptr;
+thread_local bool             t_isAnsweringRequest = false;        // A request handler runs on this thread and its response follows
+constexpr          MessageId  NullMessageId        = json::Null(); // Used for notifications which don't have an id
 
 json::Integer nextUniqueRequestId()
 {
@@ -13,6 +14,29 @@ json::Integer nextUniqueRequestId()
 	return ++s_uniqueRequestId;
 }
 
+// Progress and log messages share the lane of responses so partial results and logs of a request are never overtaken by its response.
+// Other notifications that can be sent in large numbers are written after responses and other messages.
+Connection::MessagePriority notificationPriority(std::string_view method)
+{
+	if(method == "$/progress" || method == "window/logMessage")
+		return Connection::MessagePriority::High;
+
+	if(method == "textDocument/publishDiagnostics" || method == "$/logTrace" || method == "telemetry/event")
+		return Connection::MessagePriority::Low;
+
+	return Connection::MessagePriority::Normal;
+}
+
+// Requests and notifications that a request handler sends share the lane of its response so the response can't overtake them.
+// Bulk notifications are still written last.
+Connection::MessagePriority outgoingPriority(Connection::MessagePriority priority)
+{
+	if(t_isAnsweringRequest && priority == Connection::MessagePriority::Normal)
+		return Connection::MessagePriority::High;
+
+	return priority;
+}
+
 }
 
 MessageHandler::MessageHandler(Connection& connection, unsigned int maxResponseThreads)
@@ -23,7 +47,41 @@ MessageHandler::MessageHandler(Connection& connection, unsigned int maxResponseT
 
 void MessageHandler::processIncomingMessages()
 {
-	auto messageJson = m_connection.readMessage();
+	const auto content = m_connection.readMessageContent();
+
+	// Params of messages without a handler are skipped instead of being validated
+	const auto isMethodHandled = [this](std::string_view method)
+	{
+		std::lock_guard lock{m_requestHandlersMutex};
+		const auto it = m_requestHandlersByMethod.find(method);
+
+		return it != m_requestHandlersByMethod.end() && it->second;
+	};
+
+	// Single requests and result responses are read directly from the message text
+	if(content.encoding == json::Encoding::Json)
+	{
+		if(auto envelope = jsonrpc::messageEnvelopeFromJson(content.data, isMethodHandled); envelope.has_value())
+		{
+			if(envelope->isRequest())
+			{
+				auto response = processRequest(envelope->method, envelope->id, IncomingValue{json::LazyValue::fromText(envelope->params)}, true);
+
+				if(response.has_value())
+					sendResponse(std::move(*response));
+			}
+			else
+			{
+				processResponse(*envelope->id, IncomingValue{json::LazyValue::fromText(envelope->result)}, std::nullopt);
+			}
+
+			return;
+		}
+	}
+
+	// The message tree lives in the document's arena until all requests in it are processed
+	auto  document    = content.encoding == json::Encoding::Cbor ? json::parseCborDocument(content.data) : json::parseDocument(content.data);
+	auto& messageJson = document.root();
 
 	if(messageJson.isObject())
 	{
@@ -34,7 +92,7 @@ void MessageHandler::processIncomingMessages()
 			auto response = processRequest(std::move(*request), true);
 
 			if(response.has_value())
-				m_connection.writeMessage(jsonrpc::responseToJson(std::move(*response)));
+				sendResponse(std::move(*response));
 		}
 		else
 		{
@@ -48,8 +106,9 @@ void MessageHandler::processIncomingMessages()
 
 		if(auto* requests = std::get_if<jsonrpc::RequestBatch>(&messageBatch))
 		{
-			jsonrpc::ResponseBatch responses;
-			responses.reserve(requests->size());
+			// The responses are joined into an array in the encoding that all of them were created with
+			Connection::MessageContent responses{{}, m_connection.outputEncoding()};
+			const auto isCbor = responses.encoding == json::Encoding::Cbor;
 
 			for(auto&& r : *requests)
 			{
@@ -58,11 +117,23 @@ void MessageHandler::processIncomingMessages()
 				auto response = processRequest(std::move(r), allowAsync);
 
 				if(response.has_value())
-					responses.push_back(std::move(*response));
+				{
+					assert(response->encoding == responses.encoding);
+
+					if(responses.data.empty())
+						responses.data += isCbor ? '\x9f' : '['; // CBOR array with indefinite length
+					else if(!isCbor)
+						responses.data += ',';
+
+					responses.data += response->data;
+				}
 			}
 
-			if(!responses.empty())
-				m_connection.writeMessage(jsonrpc::responseBatchToJson(std::move(responses)));
+			if(!responses.data.empty())
+			{
+				responses.data += isCbor ? '\xff' : ']';
+				sendResponse(std::move(responses));
+			}
 		}
 		else
 		{
@@ -96,77 +167,93 @@ void MessageHandler::remove(std::string_view method)
 }
 
 MessageHandler::OptionalResponse MessageHandler::processRequest(jsonrpc::Request&& request, bool allowAsync)
+{
+	return processRequest(
+		request.method,
+		request.id,
+		IncomingValue{request.params.has_value() ? std::move(*request.params) : json::LazyValue{}},
+		allowAsync);
+}
+
+MessageHandler::OptionalResponse MessageHandler::processRequest(std::string_view method, const std::optional<MessageId>& id, IncomingValue&& params, bool allowAsync)
 {
 	std::unique_lock lock{m_requestHandlersMutex};
 	OptionalResponse response;
 
-	if(const auto handlerIt = m_requestHandlersByMethod.find(request.method);
+	if(const auto handlerIt = m_requestHandlersByMethod.find(method);
 	   handlerIt != m_requestHandlersByMethod.end() && handlerIt->second)
 	{
 		assert(!t_currentRequestId);
-		if(request.id.has_value())
-			t_currentRequestId = &request.id.value();
+		if(id.has_value())
+			t_currentRequestId = &id.value();
 		else
 			t_currentRequestId = &NullMessageId;
 
+		t_isAnsweringRequest = id.has_value();
+
 		try
 		{
 			lock.unlock();
 
 			// Call handler for the method type and return optional response
-			response = handlerIt->second(
-				request.params.has_value() ? std::move(*request.params) : json::Null{},
-				allowAsync);
+			response = handlerIt->second(std::move(params), allowAsync);
 		}
 		catch(const RequestError& e)
 		{
-			if(!request.isNotification())
-			{
-				response = jsonrpc::createErrorResponse(
-					*request.id, e.code(), e.what(), e.data());
-			}
+			if(id.has_value())
+				response = createErrorResponse(*id, e.code(), e.what(), e.data());
 		}
 		catch(const json::TypeError& e)
 		{
-			if(!request.isNotification())
-			{
-				response = jsonrpc::createErrorResponse(
-					*request.id, MessageError::InvalidParams, e.what());
-			}
+			if(id.has_value())
+				response = createErrorResponse(*id, MessageError::InvalidParams, e.what());
+		}
+		catch(const json::ParseError& e)
+		{
+			// Params read directly from the message text are only validated while they are read
+			if(id.has_value())
+				response = createErrorResponse(*id, MessageError::ParseError, e.what());
 		}
 		catch(const std::exception& e)
 		{
-			if(!request.isNotification())
-			{
-				response = jsonrpc::createErrorResponse(
-					*request.id, MessageError::InternalError, e.what());
-			}
+			if(id.has_value())
+				response = createErrorResponse(*id, MessageError::InternalError, e.what());
 		}
 		catch(...)
 		{
-			t_currentRequestId = nullptr;
+			t_currentRequestId   = nullptr;
+			t_isAnsweringRequest = false;
 			throw;
 		}
 
-		t_currentRequestId = nullptr;
+		t_currentRequestId   = nullptr;
+		t_isAnsweringRequest = false;
 	}
 	else
 	{
-		if(!request.isNotification())
-			response = jsonrpc::createErrorResponse(*request.id, MessageError::MethodNotFound, "Method not found");
+		if(id.has_value())
+			response = createErrorResponse(*id, MessageError::MethodNotFound, "Method not found");
 	}
 
 	return response;
 }
 
 void MessageHandler::processResponse(jsonrpc::Response&& response)
+{
+	processResponse(
+		response.id,
+		IncomingValue{response.result.has_value() ? std::move(*response.result) : json::LazyValue{}},
+		std::move(response.error));
+}
+
+void MessageHandler::processResponse(const MessageId& id, IncomingValue&& value, std::optional<jsonrpc::Error>&& error)
 {
 	RequestResultPtr result;
 
 	// Find pending request for the response that was received based on the message id.
 	{
 		std::lock_guard lock{m_pendingRequestsMutex};
-		if(auto it = m_pendingRequests.find(response.id); it != m_pendingRequests.end())
+		if(auto it = m_pendingRequests.find(id); it != m_pendingRequests.end())
 		{
 			result = std::move(it->second);
 			m_pendingRequests.erase(it);
@@ -179,18 +266,12 @@ void MessageHandler::processResponse(jsonrpc::Response&& response)
 	try
 	{
 		assert(!t_currentRequestId);
-		t_currentRequestId = &response.id;
+		t_currentRequestId = &id;
 
-		if(response.result.has_value())
-		{
-			result->setValueFromJson(std::move(*response.result));
-		}
+		if(!error.has_value())
+			result->setValueFromJson(std::move(value));
 		else // Error response received.
-		{
-			assert(response.error.has_value());
-			auto& error = *response.error;
-			result->setError(ResponseError(error.code, std::move(error.message), std::move(error.data)));
-		}
+			result->setError(ResponseError(error->code, std::move(error->message), std::move(error->data)));
 	}
 	catch(...)
 	{
@@ -210,13 +291,13 @@ void MessageHandler::addHandler(std::string_view method, HandlerWrapper&& handle
 MessageHandler& MessageHandler::add(std::string_view method, GenericMessageCallback callback)
 {
 	addHandler(method,
-		[f = std::move(callback)](json::Any&& params, bool) -> OptionalResponse
+		[this, f = std::move(callback)](IncomingValue&& params, bool) -> OptionalResponse
 		{
 			const auto isNotification = std::holds_alternative<std::nullptr_t>(currentRequestId());
-			auto result = f(std::move(params));
+			auto result = f(params.take());
 
 			if(!isNotification)
-				return jsonrpc::createResponse(currentRequestId(), std::move(result));
+				return createResponse(currentRequestId(), result);
 
 			return std::nullopt;
 		}
@@ -228,10 +309,10 @@ MessageHandler& MessageHandler::add(std::string_view method, GenericMessageCallb
 MessageHandler& MessageHandler::add(std::string_view method, GenericAsyncMessageCallback callback)
 {
 	addHandler(method,
-		[this, f = std::move(callback)](json::Any&& params, bool allowAsync) -> OptionalResponse
+		[this, f = std::move(callback)](IncomingValue&& params, bool allowAsync) -> OptionalResponse
 		{
 			const auto isNotification = std::holds_alternative<std::nullptr_t>(currentRequestId());
-			auto future = f(std::move(params));
+			auto future = f(params.take());
 
 			if(allowAsync)
 			{
@@ -250,7 +331,7 @@ MessageHandler& MessageHandler::add(std::string_view method, GenericAsyncMessage
 			auto result = future.get();
 
 			if(!isNotification)
-				return jsonrpc::createResponse(currentRequestId(), future.get());
+				return createResponse(currentRequestId(), result);
 
 			return std::nullopt;
 		}
@@ -259,18 +340,40 @@ MessageHandler& MessageHandler::add(std::string_view method, GenericAsyncMessage
 	return *this;
 }
 
-void MessageHandler::sendResponse(jsonrpc::Response&& response)
+json::Any MessageHandler::IncomingValue::take()
+{
+	if(!m_value.isParsed())
+		return m_value.take();
+
+	// Values of a parsed message live in the arena of its document
+	return json::Any{std::allocator_arg, json::Allocator{}, m_value.take()};
+}
+
+Connection::MessageContent MessageHandler::createErrorResponse(const MessageId& id, json::Integer errorCode, json::String message, std::optional<json::Any> data) const
 {
-	m_connection.writeMessage(jsonrpc::responseToJson(std::move(response)));
+	auto       response = jsonrpc::responseToJson(jsonrpc::createErrorResponse(id, errorCode, std::move(message), std::move(data)));
+	const auto encoding = m_connection.outputEncoding();
+
+	return {encoding == json::Encoding::Cbor ? json::toCbor(response) : json::stringify(response), encoding};
+}
+
+void MessageHandler::sendResponse(Connection::MessageContent&& response)
+{
+	m_connection.queueMessageContent(std::move(response), Connection::MessagePriority::High);
 }
 
 MessageId MessageHandler::sendRequest(std::string_view method, RequestResultPtr result, std::optional<json::Any>&& params)
 {
-	std::lock_guard lock{m_pendingRequestsMutex};
 	const auto messageId = nextUniqueRequestId();
-	m_pendingRequests[messageId] = std::move(result);
+
+	// The request has to be pending before it is sent since the response can arrive at any time after that
+	{
+		std::lock_guard lock{m_pendingRequestsMutex};
+		m_pendingRequests[messageId] = std::move(result);
+	}
+
 	auto request = jsonrpc::createRequest(messageId, method, std::move(params));
-	m_connection.writeMessage(jsonrpc::requestToJson(std::move(request)));
+	m_connection.queueMessage(jsonrpc::requestToJson(std::move(request)), outgoingPriority(Connection::MessagePriority::Normal));
 	return messageId;
 }
 
@@ -297,7 +400,7 @@ FutureResponse<MessageHandler::GenericMessage> MessageHandler::sendRequest(std::
 void MessageHandler::sendNotification(std::string_view method, std::optional<json::Any>&& params)
 {
 	auto notification = jsonrpc::createNotification(method, std::move(params));
-	m_connection.writeMessage(jsonrpc::requestToJson(std::move(notification)));
+	m_connection.queueMessage(jsonrpc::requestToJson(std::move(notification)), outgoingPriority(notificationPriority(method)));
 }
 
 } // namespace lsp
@@ -103,10 +103,11 @@ public:
 private:
 	class ResponseResultBase;
 	class RequestResultBase;
+	class IncomingValue;
 	using RequestResultPtr  = std::unique_ptr<RequestResultBase>;
 	using ResponseResultPtr = std::unique_ptr<ResponseResultBase>;
-	using OptionalResponse  = std::optional<jsonrpc::Response>;
-	using HandlerWrapper    = std::function<OptionalResponse(json::Any&&, bool)>;
+	using OptionalResponse  = std::optional<Connection::MessageContent>; // Serialized response message
+	using HandlerWrapper    = std::function<OptionalResponse(IncomingValue&&, bool)>;
 
 	// General
 	Connection&                                      m_connection;
@@ -119,17 +120,39 @@ private:
 	std::unordered_map<MessageId, RequestResultPtr>  m_pendingRequests;
 
 	template<typename T>
-	static jsonrpc::Response createResponse(const MessageId& id, T&& result);
+	Connection::MessageContent createResponse(const MessageId& id, const T& result) const;
 
 	template<typename M>
-	static jsonrpc::Response createResponseFromAsyncResult(const MessageId& id, AsyncRequestResult<M>& result);
+	Connection::MessageContent createResponseFromAsyncResult(const MessageId& id, AsyncRequestResult<M>& result) const;
+
+	Connection::MessageContent createErrorResponse(const MessageId& id, json::Integer errorCode, json::String message, std::optional<json::Any> data = std::nullopt) const;
 
 	OptionalResponse processRequest(jsonrpc::Request&& request, bool allowAsync);
+	OptionalResponse processRequest(std::string_view method, const std::optional<MessageId>& id, IncomingValue&& params, bool allowAsync);
 	void addHandler(std::string_view method, HandlerWrapper&& handlerFunc);
-	void sendResponse(jsonrpc::Response&& response);
+	void sendResponse(Connection::MessageContent&& response);
 	void processResponse(jsonrpc::Response&& response);
+	void processResponse(const MessageId& id, IncomingValue&& result, std::optional<jsonrpc::Error>&& error);
 	MessageId sendRequest(std::string_view method, RequestResultPtr result, std::optional<json::Any>&& params = std::nullopt);
 
+	/*
+	 * Incoming params or result.
+	 * Typed values are read directly from the json text if the value was not parsed yet.
+	 */
+
+	class IncomingValue{
+	public:
+		explicit IncomingValue(json::LazyValue&& value) : m_value{std::move(value)}{}
+
+		template<typename T>
+		void read(T& value);
+
+		json::Any take();
+
+	private:
+		json::LazyValue m_value;
+	};
+
 	/*
 	 * Request result wrapper
 	 */
@@ -137,7 +160,7 @@ private:
 	class RequestResultBase{
 	public:
 		virtual ~RequestResultBase() = default;
-		virtual void setValueFromJson(json::Any&& json) = 0;
+		virtual void setValueFromJson(IncomingValue&& json) = 0;
 		virtual void setError(ResponseError&& error) = 0;
 	};
 
@@ -150,7 +173,7 @@ private:
 		{
 		}
 
-		void setValueFromJson(json::Any&& json) override;
+		void setValueFromJson(IncomingValue&& json) override;
 		void setError(ResponseError&& error) override;
 
 	private:
@@ -163,7 +186,7 @@ private:
 	public:
 		std::future<T> future(){ return m_promise.get_future(); }
 
-		void setValueFromJson(json::Any&& json) override;
+		void setValueFromJson(IncomingValue&& json) override;
 		void setError(ResponseError&& error) override;
 
 	private:
@@ -4,18 +4,50 @@
 
 namespace lsp{
 
+/*
+ * IncomingValue
+ */
+
+template<typename T>
+void MessageHandler::IncomingValue::read(T& value)
+{
+	if(!m_value.isParsed())
+	{
+		json::Reader reader{m_value.text()};
+		reader.next();
+		fromJson(reader, value);
+	}
+	else
+	{
+		fromJson(std::move(m_value.value()), value);
+	}
+}
+
 /*
  * createResponse
  */
 
 template<typename T>
-jsonrpc::Response MessageHandler::createResponse(const MessageId& id, T&& result)
+Connection::MessageContent MessageHandler::createResponse(const MessageId& id, const T& result) const
 {
-	return jsonrpc::createResponse(id, toJson(std::forward<T>(result)));
+	// The result is written directly into the message content without creating a json::Any first
+	Connection::MessageContent message{{}, m_connection.outputEncoding()};
+	json::Writer               writer{message.data, message.encoding};
+
+	writer.startObject();
+	writer.key("jsonrpc");
+	writer.string(jsonrpc::ProtocolVersion);
+	writer.key("id");
+	toJson(writer, id);
+	writer.key("result");
+	toJson(writer, result);
+	writer.endObject();
+
+	return message;
 }
 
 template<typename M>
-jsonrpc::Response MessageHandler::createResponseFromAsyncResult(const MessageId& id, AsyncRequestResult<M>& result)
+Connection::MessageContent MessageHandler::createResponseFromAsyncResult(const MessageId& id, AsyncRequestResult<M>& result) const
 {
 	try
 	{
@@ -23,11 +55,11 @@ jsonrpc::Response MessageHandler::createResponseFromAsyncResult(const MessageId&
 	}
 	catch(const RequestError& e)
 	{
-		return jsonrpc::createErrorResponse(id, e.code(), e.what());
+		return createErrorResponse(id, e.code(), e.what());
 	}
 	catch(std::exception& e)
 	{
-		return jsonrpc::createErrorResponse(id, MessageError::InternalError, e.what());
+		return createErrorResponse(id, MessageError::InternalError, e.what());
 	}
 }
 
@@ -39,10 +71,10 @@ template<typename M, typename F>
 MessageHandler& MessageHandler::add(F&& handlerFunc) requires IsRequestCallback<M, F>
 {
 	addHandler(M::Method,
-	[this, f = std::forward<F>(handlerFunc)](json::Any&& json, bool allowAsync) -> OptionalResponse
+	[this, f = std::forward<F>(handlerFunc)](IncomingValue&& json, bool allowAsync) -> OptionalResponse
 	{
 		typename M::Params params;
-		fromJson(std::move(json), params);
+		json.read(params);
 		const auto& id = currentRequestId();
 
 		if constexpr(IsCallbackResult<AsyncRequestResult<M>, typename M::Params, F>)
@@ -64,7 +96,6 @@ MessageHandler& MessageHandler::add(F&& handlerFunc) requires IsRequestCallback<
 		}
 		else
 		{
-			(void)this;
 			(void)allowAsync;
 			return createResponse(id, f(std::move(params)));
 		}
@@ -77,7 +108,7 @@ template<typename M, typename F>
 MessageHandler& MessageHandler::add(F&& handlerFunc) requires IsNoParamsRequestCallback<M, F>
 {
 	addHandler(M::Method,
-	[this, f = std::forward<F>(handlerFunc)](json::Any&&, bool allowAsync) -> OptionalResponse
+	[this, f = std::forward<F>(handlerFunc)](IncomingValue&&, bool allowAsync) -> OptionalResponse
 	{
 		const auto& id = currentRequestId();
 
@@ -100,7 +131,6 @@ MessageHandler& MessageHandler::add(F&& handlerFunc) requires IsNoParamsRequestC
 		}
 		else
 		{
-			(void)this;
 			(void)allowAsync;
 			return createResponse(id, f());
 		}
@@ -113,10 +143,10 @@ template<typename M, typename F>
 MessageHandler& MessageHandler::add(F&& handlerFunc) requires IsNotificationCallback<M, F>
 {
 	addHandler(M::Method,
-	[this, f = std::forward<F>(handlerFunc)](json::Any&& json, bool allowAsync) -> OptionalResponse
+	[this, f = std::forward<F>(handlerFunc)](IncomingValue&& json, bool allowAsync) -> OptionalResponse
 	{
 		typename M::Params params;
-		fromJson(std::move(json), params);
+		json.read(params);
 
 		if constexpr(IsCallbackResult<AsyncNotificationResult, typename M::Params, F>)
 		{
@@ -151,7 +181,7 @@ template<typename M, typename F>
 MessageHandler& MessageHandler::add(F&& handlerFunc) requires IsNoParamsNotificationCallback<M, F>
 {
 	addHandler(M::Method,
-	[this, f = std::forward<F>(handlerFunc)](json::Any&&, bool allowAsync) -> OptionalResponse
+	[this, f = std::forward<F>(handlerFunc)](IncomingValue&&, bool allowAsync) -> OptionalResponse
 	{
 		if constexpr(IsNoParamsCallbackResult<AsyncNotificationResult, F>)
 		{
@@ -239,12 +269,12 @@ void MessageHandler::sendNotification() requires SendNoParamsNotification<M>
  */
 
 template<typename T>
-void MessageHandler::FutureRequestResult<T>::setValueFromJson(json::Any&& json)
+void MessageHandler::FutureRequestResult<T>::setValueFromJson(IncomingValue&& json)
 {
 	try
 	{
 		auto value = T();
-		fromJson(std::move(json), value);
+		json.read(value);
 		m_promise.set_value(std::move(value));
 	}
 	catch(const Exception& e)
@@ -264,12 +294,12 @@ void MessageHandler::FutureRequestResult<T>::setError(ResponseError&& error)
  */
 
 template<typename T, typename F, typename E>
-void MessageHandler::CallbackRequestResult<T, F, E>::setValueFromJson(json::Any&& json)
+void MessageHandler::CallbackRequestResult<T, F, E>::setValueFromJson(IncomingValue&& json)
 {
 	try
 	{
 		auto value = T();
-		fromJson(std::move(json), value);
+		json.read(value);
 		m_then(std::move(value));
 	}
 	catch(const json::Error& error)
@@ -1,5 +1,8 @@
 #include <lsp/process.h>
 #include <lsp/io/stream.h>
+#include <lsp/io/sharedmemorystream.h>
+#include <lsp/io/writebatch.h>
+#include <algorithm>
 
 #ifndef LSP_PROCESS_UNSUPPORTED
 
@@ -10,7 +13,9 @@
 #include <unistd.h>
 #include <string.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <signal.h>
+#include <sys/uio.h>
 #include <sys/wait.h>
 #elif defined(LSP_PROCESS_WIN32)
 #define WIN32_LEAN_AND_MEAN
@@ -25,7 +30,7 @@ struct Process::Impl final : public io::Stream{
 	int   m_stdoutRead = -1;
 	pid_t m_pid        = -1;
 
-	Impl(const std::string& executable, const ArgList& args)
+	Impl(const std::string& executable, const ArgList& args, int sharedMemoryFd = -1)
 	{
 		int inPipe[2]; // Parent writes to child (stdin)
 		int outPipe[2]; // Parent reads from child (stdout)
@@ -62,6 +67,27 @@ struct Process::Impl final : public io::Stream{
 		const char* const file = executable.c_str();
 		char** const      argv = argList.data();
 
+#ifndef LSP_SHARED_MEMORY_UNSUPPORTED
+		// The environment tells the process which inherited descriptor it can attach to
+		const auto sharedMemoryVariable = std::string(io::SharedMemoryStream::EnvironmentVariable) + '=';
+		auto       sharedMemoryEntry    = sharedMemoryVariable + std::to_string(sharedMemoryFd);
+		auto       environment          = std::vector<char*>();
+
+		if(sharedMemoryFd != -1)
+		{
+			for(char** entry = environ; *entry; ++entry)
+			{
+				if(!std::string_view(*entry).starts_with(sharedMemoryVariable))
+					environment.push_back(*entry);
+			}
+
+			environment.push_back(sharedMemoryEntry.data());
+			environment.push_back(nullptr);
+		}
+#else
+		(void)sharedMemoryFd;
+#endif
+
 		// fork
 
 		m_pid = fork();
@@ -87,6 +113,14 @@ struct Process::Impl final : public io::Stream{
 			close(errPipe[0]);
 			fcntl(errPipe[1], F_SETFD, FD_CLOEXEC);
 
+#ifndef LSP_SHARED_MEMORY_UNSUPPORTED
+			if(sharedMemoryFd != -1)
+			{
+				fcntl(sharedMemoryFd, F_SETFD, 0);
+				execvpe(file, argv, environment.data());
+			}
+			else
+#endif
 			execvp(file, argv);
 
 			const auto error = errno;
@@ -116,6 +150,10 @@ struct Process::Impl final : public io::Stream{
 
 			m_stdinWrite = inPipe[1];
 			m_stdoutRead = outPipe[0];
+
+			// Allows event loops to use the pipes. The blocking functions wait until they are ready instead.
+			fcntl(m_stdinWrite, F_SETFL, fcntl(m_stdinWrite, F_GETFL) | O_NONBLOCK);
+			fcntl(m_stdoutRead, F_SETFL, fcntl(m_stdoutRead, F_GETFL) | O_NONBLOCK);
 		}
 	}
 
@@ -183,6 +221,13 @@ struct Process::Impl final : public io::Stream{
 		}
 	}
 
+	static void waitUntilReady(int fd, short events)
+	{
+		pollfd pollFd{fd, events, 0};
+
+		while(::poll(&pollFd, 1, -1) < 0 && errno == EINTR);
+	}
+
 	void read(char* buffer, std::size_t size) override
 	{
 		std::size_t totalBytesRead = 0;
@@ -196,13 +241,49 @@ struct Process::Impl final : public io::Stream{
 				if(errno == EINTR)
 					continue;
 
+				if(errno == EAGAIN || errno == EWOULDBLOCK)
+				{
+					waitUntilReady(m_stdoutRead, POLLIN);
+					continue;
+				}
+
 				throw io::Error(std::string("Failed to read from process stdout: ") + strerror(errno));
 			}
 
+			if(bytesRead == 0)
+				throw io::Error("Failed to read from process stdout: Unexpected end of stream");
+
 			totalBytesRead += static_cast<std::size_t>(bytesRead);
 		}
 	}
 
+	std::size_t readSome(char* buffer, std::size_t size) override
+	{
+		if(size == 0)
+			return 0;
+
+		while(true)
+		{
+			const auto bytesRead = ::read(m_stdoutRead, buffer, size);
+
+			if(bytesRead < 0)
+			{
+				if(errno == EINTR)
+					continue;
+
+				if(errno == EAGAIN || errno == EWOULDBLOCK)
+				{
+					waitUntilReady(m_stdoutRead, POLLIN);
+					continue;
+				}
+
+				throw io::Error(std::string("Failed to read from process stdout: ") + strerror(errno));
+			}
+
+			return static_cast<std::size_t>(bytesRead);
+		}
+	}
+
 	void write(const char* buffer, std::size_t size) override
 	{
 		std::size_t totalBytesWritten = 0;
@@ -216,12 +297,125 @@ struct Process::Impl final : public io::Stream{
 				if(errno == EINTR)
 					continue;
 
+				if(errno == EAGAIN || errno == EWOULDBLOCK)
+				{
+					waitUntilReady(m_stdinWrite, POLLOUT);
+					continue;
+				}
+
 				throw io::Error(std::string("Failed to write to process stdin: ") + strerror(errno));
 			}
 
 			totalBytesWritten += static_cast<std::size_t>(bytesWritten);
 		}
 	}
+
+	void writeBuffers(std::span<const std::string_view> buffers) override
+	{
+		while(!buffers.empty())
+		{
+			const auto batchSize = std::min(buffers.size(), io::MaxWriteBatchSize);
+			iovec      vectors[io::MaxWriteBatchSize];
+
+			for(std::size_t i = 0; i < batchSize; ++i)
+				vectors[i] = {const_cast<char*>(buffers[i].data()), buffers[i].size()};
+
+			for(auto remaining = std::span{vectors, batchSize}; !remaining.empty();)
+			{
+				const auto bytesWritten = ::writev(m_stdinWrite, remaining.data(), static_cast<int>(remaining.size()));
+
+				if(bytesWritten < 0)
+				{
+					if(errno == EINTR)
+						continue;
+
+					if(errno == EAGAIN || errno == EWOULDBLOCK)
+					{
+						waitUntilReady(m_stdinWrite, POLLOUT);
+						continue;
+					}
+
+					throw io::Error(std::string("Failed to write to process stdin: ") + strerror(errno));
+				}
+
+				io::skipWritten(remaining, static_cast<std::size_t>(bytesWritten));
+			}
+
+			buffers = buffers.subspan(batchSize);
+		}
+	}
+
+	int readDescriptor() const override
+	{
+		return m_stdoutRead;
+	}
+
+	int writeDescriptor() const override
+	{
+		return m_stdinWrite;
+	}
+
+	std::optional<std::size_t> tryReadSome(char* buffer, std::size_t size) override
+	{
+		if(size == 0)
+			return 0;
+
+		while(true)
+		{
+			const auto bytesRead = ::read(m_stdoutRead, buffer, size);
+
+			if(bytesRead >= 0)
+				return static_cast<std::size_t>(bytesRead);
+
+			if(errno == EINTR)
+				continue;
+
+			if(errno == EAGAIN || errno == EWOULDBLOCK)
+				return std::nullopt;
+
+			throw io::Error(std::string("Failed to read from process stdout: ") + strerror(errno));
+		}
+	}
+
+	std::size_t tryWriteBuffers(std::span<const std::string_view> buffers) override
+	{
+		std::size_t totalBytesWritten = 0;
+
+		while(!buffers.empty())
+		{
+			const auto  batchSize  = std::min(buffers.size(), io::MaxWriteBatchSize);
+			std::size_t batchBytes = 0;
+			iovec       vectors[io::MaxWriteBatchSize];
+
+			for(std::size_t i = 0; i < batchSize; ++i)
+			{
+				vectors[i] = {const_cast<char*>(buffers[i].data()), buffers[i].size()};
+				batchBytes += buffers[i].size();
+			}
+
+			const auto bytesWritten = ::writev(m_stdinWrite, vectors, static_cast<int>(batchSize));
+
+			if(bytesWritten < 0)
+			{
+				if(errno == EINTR)
+					continue;
+
+				if(errno == EAGAIN || errno == EWOULDBLOCK)
+					break;
+
+				throw io::Error(std::string("Failed to write to process stdin: ") + strerror(errno));
+			}
+
+			totalBytesWritten += static_cast<std::size_t>(bytesWritten);
+
+			if(static_cast<std::size_t>(bytesWritten) < batchBytes)
+				break;
+
+			buffers = buffers.subspan(batchSize);
+		}
+
+		return totalBytesWritten;
+	}
 #elif defined(LSP_PROCESS_WIN32)
 	HANDLE              m_stdinRead    = nullptr;
 	HANDLE              m_stdinWrite   = nullptr;
@@ -392,6 +586,23 @@ struct Process::Impl final : public io::Stream{
 		}
 	}
 
+	std::size_t readSome(char* buffer, std::size_t size) override
+	{
+		if(size == 0)
+			return 0;
+
+		DWORD bytesRead;
+		if(!ReadFile(m_stdoutRead, buffer, static_cast<DWORD>(size), &bytesRead, nullptr))
+		{
+			if(GetLastError() == ERROR_BROKEN_PIPE)
+				return 0;
+
+			throw io::Error(std::string("Failed to read from process stdout"));
+		}
+
+		return bytesRead;
+	}
+
 	void write(const char* buffer, std::size_t size) override
 	{
 		std::size_t totalBytesWritten = 0;
@@ -434,6 +645,23 @@ Process Process::start(const std::string& executable, const ArgList& args)
 	return Process(std::make_unique<Process::Impl>(executable, args));
 }
 
+#ifndef LSP_SHARED_MEMORY_UNSUPPORTED
+
+Process::Process(const std::string& executable, const ArgList& args, io::SharedMemoryStream& sharedMemory)
+{
+	*this = start(executable, args, sharedMemory);
+}
+
+Process Process::start(const std::string& executable, const ArgList& args, io::SharedMemoryStream& sharedMemory)
+{
+	if(sharedMemory.descriptor() == -1)
+		throw ProcessError("Only the side that created the shared memory can pass it on");
+
+	return Process(std::make_unique<Process::Impl>(executable, args, sharedMemory.descriptor()));
+}
+
+#endif
+
 bool Process::isRunning() const
 {
 	return m_impl && m_impl->checkRunning();
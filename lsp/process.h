@@ -19,6 +19,7 @@
 namespace lsp{
 namespace io{
 class Stream;
+class SharedMemoryStream;
 } // namespace io
 
 /*
@@ -45,6 +46,11 @@ public:
 	~Process();
 
 	[[nodiscard]] static Process start(const std::string& executable, const ArgList& args = {});
+#ifdef __linux__
+	// Passes the shared memory stream on to the process which attaches to it with io::SharedMemoryStream::fromEnvironment
+	Process(const std::string& executable, const ArgList& args, io::SharedMemoryStream& sharedMemory);
+	[[nodiscard]] static Process start(const std::string& executable, const ArgList& args, io::SharedMemoryStream& sharedMemory);
+#endif
 
 	[[nodiscard]] bool isRunning() const;
 	[[nodiscard]] io::Stream& stdIO();
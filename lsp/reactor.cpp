@@ -0,0 +1,404 @@
+#include <lsp/reactor.h>
+
+#ifndef LSP_REACTOR_UNSUPPORTED
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <lsp/connection.h>
+#include <lsp/messagehandler.h>
+#include <lsp/io/socket.h>
+#include <lsp/io/stream.h>
+
+namespace lsp{
+namespace{
+
+// The reactor that is processing events on the current thread
+thread_local const Reactor* t_currentReactor = nullptr;
+
+// The lower bits of the event data tell where an event came from and the rest is the id of the session or listener
+enum EventSource : std::uint64_t{
+	SessionInput,
+	SessionOutput,
+	ListenerInput,
+	Wake
+};
+
+constexpr std::uint64_t EventSourceBits = 2;
+constexpr std::uint64_t EventSourceMask = (1 << EventSourceBits) - 1;
+
+[[noreturn]] void throwError(const std::string& message)
+{
+	throw io::Error(message + ": " + std::strerror(errno));
+}
+
+void controlEvents(int epollFd, int operation, int fd, std::uint32_t events, std::uint64_t id, EventSource source)
+{
+	auto event = epoll_event{};
+	event.events   = events;
+	event.data.u64 = (id << EventSourceBits) | source;
+
+	if(epoll_ctl(epollFd, operation, fd, &event) != 0)
+		throwError("Failed to register file descriptor for events");
+}
+
+} // namespace
+
+/*
+ * Reactor::Session
+ */
+
+struct Reactor::Session{
+	std::uint64_t   id;
+	Connection&     connection;
+	MessageHandler& messageHandler;
+	CloseCallback   onClose;
+	int             readFd;
+	int             writeFd;
+	bool            isReading = true;  // False while the output queue is full
+	bool            isWriting = false; // True while waiting for the stream to become writable
+	bool            isRemoved = false;
+};
+
+struct Reactor::Listener{
+	io::SocketListener& listener;
+	AcceptCallback      onAccept;
+};
+
+/*
+ * Reactor
+ */
+
+Reactor::Reactor()
+{
+	m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+
+	if(m_epollFd == -1)
+		throwError("Failed to create epoll instance");
+
+	m_wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+	if(m_wakeFd == -1)
+	{
+		::close(m_epollFd);
+		throwError("Failed to create eventfd");
+	}
+
+	controlEvents(m_epollFd, EPOLL_CTL_ADD, m_wakeFd, EPOLLIN, 0, Wake);
+}
+
+Reactor::~Reactor()
+{
+	// Connections that are still registered go back to writing with their own thread
+	for(auto& [id, session] : m_sessions)
+		session->connection.setMessageQueuedCallback({});
+
+	::close(m_wakeFd);
+	::close(m_epollFd);
+}
+
+void Reactor::add(Connection& connection, MessageHandler& messageHandler, CloseCallback onClose)
+{
+	const auto readFd  = connection.m_stream.readDescriptor();
+	const auto writeFd = connection.m_stream.writeDescriptor();
+
+	if(readFd == -1 || writeFd == -1)
+		throw io::Error{"The stream of the connection does not support non-blocking I/O"};
+
+	Session* session;
+
+	{
+		std::lock_guard lock{m_mutex};
+		const auto id = ++m_nextId;
+		auto&      entry = m_sessions[id];
+
+		entry.reset(new Session{id, connection, messageHandler, std::move(onClose), readFd, writeFd});
+		session = entry.get();
+	}
+
+	controlEvents(m_epollFd, EPOLL_CTL_ADD, readFd, EPOLLIN, session->id, SessionInput);
+	connection.setMessageQueuedCallback([this, id = session->id](){ messageQueued(id); });
+}
+
+void Reactor::remove(Connection& connection)
+{
+	std::unique_lock lock{m_mutex};
+	auto it = m_sessions.begin();
+
+	while(it != m_sessions.end() && &it->second->connection != &connection)
+		++it;
+
+	if(it == m_sessions.end())
+		return;
+
+	auto session = std::move(it->second);
+	m_sessions.erase(it);
+	lock.unlock();
+
+	epoll_ctl(m_epollFd, EPOLL_CTL_DEL, session->readFd, nullptr);
+
+	if(session->isWriting && session->writeFd != session->readFd)
+		epoll_ctl(m_epollFd, EPOLL_CTL_DEL, session->writeFd, nullptr);
+
+	session->isRemoved = true;
+	session->connection.setMessageQueuedCallback({});
+
+	// Events for the session that were already received might still be processed
+	if(t_currentReactor == this)
+		m_removedSessions.push_back(std::move(session));
+}
+
+void Reactor::addListener(io::SocketListener& listener, AcceptCallback onAccept)
+{
+	const auto fd = listener.readDescriptor();
+
+	if(fd == -1)
+		throw io::Error{"The listener does not support non-blocking I/O"};
+
+	std::uint64_t id;
+
+	{
+		std::lock_guard lock{m_mutex};
+		id = ++m_nextId;
+		m_listeners[id].reset(new Listener{listener, std::move(onAccept)});
+	}
+
+	controlEvents(m_epollFd, EPOLL_CTL_ADD, fd, EPOLLIN, id, ListenerInput);
+}
+
+void Reactor::removeListener(io::SocketListener& listener)
+{
+	std::lock_guard lock{m_mutex};
+
+	for(auto it = m_listeners.begin(); it != m_listeners.end(); ++it)
+	{
+		if(&it->second->listener == &listener)
+		{
+			epoll_ctl(m_epollFd, EPOLL_CTL_DEL, listener.readDescriptor(), nullptr);
+			m_listeners.erase(it);
+			break;
+		}
+	}
+}
+
+void Reactor::run()
+{
+	while(!m_stopRequested.load())
+		poll();
+
+	m_stopRequested = false;
+}
+
+std::size_t Reactor::poll(int timeout)
+{
+	constexpr int MaxEvents = 64;
+	epoll_event   events[MaxEvents];
+
+	const auto eventCount = epoll_wait(m_epollFd, events, MaxEvents, timeout);
+
+	if(eventCount < 0)
+	{
+		if(errno == EINTR)
+			return 0;
+
+		throwError("Failed to wait for events");
+	}
+
+	// Errors of listeners are passed on to the caller
+	struct CurrentReactorScope{
+		const Reactor* previous = t_currentReactor;
+		explicit CurrentReactorScope(const Reactor* reactor){ t_currentReactor = reactor; }
+		~CurrentReactorScope(){ t_currentReactor = previous; }
+	} currentReactorScope{this};
+
+	for(int i = 0; i < eventCount; ++i)
+	{
+		const auto flags  = events[i].events;
+		const auto source = static_cast<EventSource>(events[i].data.u64 & EventSourceMask);
+		const auto id     = events[i].data.u64 >> EventSourceBits;
+
+		if(source == Wake)
+		{
+			std::uint64_t value;
+			[[maybe_unused]] const auto result = ::read(m_wakeFd, &value, sizeof(value));
+
+			std::lock_guard lock{m_mutex};
+			m_wakePending = false;
+		}
+		else if(source == ListenerInput)
+		{
+			Listener* listener = nullptr;
+
+			{
+				std::lock_guard lock{m_mutex};
+				if(const auto it = m_listeners.find(id); it != m_listeners.end())
+					listener = it->second.get();
+			}
+
+			// Accepts all pending connections
+			while(listener)
+			{
+				auto socket = listener->listener.tryListen();
+
+				if(!socket.has_value())
+					break;
+
+				listener->onAccept(std::move(*socket));
+			}
+		}
+		else if(auto* session = findSession(id); session)
+		{
+			try
+			{
+				// Sockets use the same descriptor for both directions
+				if(source == SessionOutput || (flags & EPOLLOUT))
+					processOutput(*session);
+
+				if(source == SessionInput && !session->isRemoved && (flags & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+					processInput(*session);
+			}
+			catch(...)
+			{
+				if(!session->isRemoved)
+					close(*session, std::current_exception());
+			}
+		}
+	}
+
+	processPendingOutput();
+	m_removedSessions.clear();
+
+	return static_cast<std::size_t>(eventCount);
+}
+
+void Reactor::stop()
+{
+	m_stopRequested = true;
+
+	const std::uint64_t value = 1;
+	[[maybe_unused]] const auto result = ::write(m_wakeFd, &value, sizeof(value));
+}
+
+Reactor::Session* Reactor::findSession(std::uint64_t id)
+{
+	std::lock_guard lock{m_mutex};
+	const auto      it = m_sessions.find(id);
+
+	return it != m_sessions.end() ? it->second.get() : nullptr;
+}
+
+void Reactor::updateEvents(Session& session, bool wasWriting)
+{
+	const auto readEvents = session.isReading ? EPOLLIN : 0u;
+
+	if(session.readFd == session.writeFd)
+	{
+		controlEvents(m_epollFd, EPOLL_CTL_MOD, session.readFd, readEvents | (session.isWriting ? EPOLLOUT : 0u), session.id, SessionInput);
+		return;
+	}
+
+	controlEvents(m_epollFd, EPOLL_CTL_MOD, session.readFd, readEvents, session.id, SessionInput);
+
+	// The write descriptor of pipes is only registered while there is something to write
+	if(session.isWriting && !wasWriting)
+		controlEvents(m_epollFd, EPOLL_CTL_ADD, session.writeFd, EPOLLOUT, session.id, SessionOutput);
+	else if(!session.isWriting && wasWriting)
+		epoll_ctl(m_epollFd, EPOLL_CTL_DEL, session.writeFd, nullptr);
+}
+
+void Reactor::processInput(Session& session)
+{
+	if(!session.connection.receiveAvailable())
+		return;
+
+	while(!session.isRemoved && session.connection.hasBufferedMessage())
+		session.messageHandler.processIncomingMessages();
+
+	// Reading continues once the peer received enough of the output
+	if(!session.isRemoved && session.connection.isOutputQueueFull())
+	{
+		session.isReading = false;
+		updateEvents(session, session.isWriting);
+	}
+}
+
+void Reactor::processOutput(Session& session)
+{
+	const auto wasWriting = session.isWriting;
+	const auto wasReading = session.isReading;
+
+	session.isWriting = !session.connection.writeQueuedMessages();
+	session.isReading = wasReading || !session.connection.isOutputQueueFull();
+
+	if(session.isWriting != wasWriting || session.isReading != wasReading)
+		updateEvents(session, wasWriting);
+}
+
+void Reactor::processPendingOutput()
+{
+	std::vector<std::uint64_t> pendingOutput;
+
+	while(true)
+	{
+		{
+			std::lock_guard lock{m_mutex};
+			pendingOutput.swap(m_pendingOutput);
+		}
+
+		if(pendingOutput.empty())
+			break;
+
+		for(const auto id : pendingOutput)
+		{
+			auto* session = findSession(id);
+
+			// Sessions that wait for the stream to become writable continue once it is
+			if(!session || session->isWriting)
+				continue;
+
+			try
+			{
+				processOutput(*session);
+			}
+			catch(...)
+			{
+				close(*session, std::current_exception());
+			}
+		}
+
+		pendingOutput.clear();
+	}
+}
+
+void Reactor::messageQueued(std::uint64_t id)
+{
+	{
+		std::lock_guard lock{m_mutex};
+		m_pendingOutput.push_back(id);
+
+		// Messages queued while processing events are written once all events are processed
+		if(t_currentReactor == this || m_wakePending)
+			return;
+
+		m_wakePending = true;
+	}
+
+	const std::uint64_t value = 1;
+	[[maybe_unused]] const auto result = ::write(m_wakeFd, &value, sizeof(value));
+}
+
+void Reactor::close(Session& session, std::exception_ptr error)
+{
+	auto onClose = std::move(session.onClose);
+	remove(session.connection);
+
+	if(onClose)
+		onClose(error);
+}
+
+} // namespace lsp
+
+#endif // LSP_REACTOR_UNSUPPORTED
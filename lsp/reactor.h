@@ -0,0 +1,102 @@
+#pragma once
+
+#ifdef __linux__
+	#define LSP_REACTOR_EPOLL
+#else
+	#define LSP_REACTOR_UNSUPPORTED
+#endif
+
+#ifndef LSP_REACTOR_UNSUPPORTED
+
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace lsp{
+
+class Connection;
+class MessageHandler;
+
+namespace io{
+class Socket;
+class SocketListener;
+} // namespace io
+
+/*
+ * Event loop that serves many connections from a single thread (Linux only).
+ *
+ * The input of registered connections is read without blocking as soon as it arrives and every complete message is
+ * passed to the message handler of its connection. Queued messages are written whenever the stream is writable instead
+ * of by a writer thread per connection. A server can run several reactors on their own threads to spread the load.
+ *
+ * Messages of registered connections have to be queued instead of written directly which MessageHandler always does.
+ *
+ * Synchronous request and notification handlers run on the thread of the reactor and stall all of its connections
+ * while they run. They must not block on anything the reactor itself has to do. Waiting for the response to a request
+ * with sendRequest(...).future.get() or for I/O of another connection of the same reactor deadlocks it.
+ * Handlers that take long or have to wait should be asynchronous, which runs them on the worker threads of the
+ * message handler, or use the callback overload of sendRequest.
+ */
+class Reactor{
+public:
+	// Invoked after a connection was removed because its stream was closed or reading or writing a message failed
+	using CloseCallback  = std::function<void(std::exception_ptr error)>;
+	using AcceptCallback = std::function<void(io::Socket&& socket)>;
+
+	Reactor();
+	~Reactor();
+
+	/*
+	 * The stream of the connection has to provide descriptors for non-blocking I/O.
+	 * The connection and message handler have to stay alive until the connection is removed.
+	 * remove can only be called by the thread that runs the reactor (e.g. from a callback) or while it isn't running.
+	 */
+	void add(Connection& connection, MessageHandler& messageHandler, CloseCallback onClose = {});
+	void remove(Connection& connection);
+
+	// Accepted sockets are passed to the callback which usually adds a connection for them
+	void addListener(io::SocketListener& listener, AcceptCallback onAccept);
+	void removeListener(io::SocketListener& listener);
+
+	// Processes events until stop is called
+	void run();
+	// Waits up to timeout milliseconds or forever if it is negative and processes the events that occurred.
+	// Returns the number of events.
+	std::size_t poll(int timeout = -1);
+	// Can be called from any thread
+	void stop();
+
+private:
+	struct Session;
+	struct Listener;
+	using SessionPtr  = std::unique_ptr<Session>;
+	using ListenerPtr = std::unique_ptr<Listener>;
+
+	int                                            m_epollFd       = -1;
+	int                                            m_wakeFd        = -1;
+	std::atomic<bool>                              m_stopRequested = false;
+	std::uint64_t                                  m_nextId        = 0;
+	std::mutex                                     m_mutex;
+	std::unordered_map<std::uint64_t, SessionPtr>  m_sessions;
+	std::unordered_map<std::uint64_t, ListenerPtr> m_listeners;
+	std::vector<SessionPtr>                        m_removedSessions; // Destroyed once the current events are processed
+	std::vector<std::uint64_t>                     m_pendingOutput;   // Sessions with newly queued messages
+	bool                                           m_wakePending   = false;
+
+	Session* findSession(std::uint64_t id);
+	void updateEvents(Session& session, bool wasWriting);
+	void processInput(Session& session);
+	void processOutput(Session& session);
+	void processPendingOutput();
+	void messageQueued(std::uint64_t id);
+	void close(Session& session, std::exception_ptr error);
+};
+
+} // namespace lsp
+
+#endif // LSP_REACTOR_UNSUPPORTED
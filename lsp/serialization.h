@@ -5,8 +5,13 @@
 #include <iterator>
 #include <limits>
 #include <memory>
+#include <span>
+#include <string>
 #include <tuple>
 #include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
 #include <lsp/enumeration.h>
 #include <lsp/fileuri.h>
 #include <lsp/json/json.h>
@@ -59,6 +64,36 @@ json::Any toJson(std::unique_ptr<T>&& v);
 template<typename T>
 json::Any toJson(std::optional<T>&& v);
 
+// toJson (json::Writer)
+// Appends the json text of the value to the writer without creating a json::Any.
+
+template<typename... Args>
+void toJson(json::Writer& writer, const std::tuple<Args...>& tuple);
+
+template<typename K, typename T>
+void toJson(json::Writer& writer, const StrMap<K, T>& map);
+
+template<typename T>
+void toJson(json::Writer& writer, const std::vector<T>& vector);
+
+template<typename... Args>
+void toJson(json::Writer& writer, const std::variant<Args...>& variant);
+
+template<typename EnumType, typename ValueType>
+void toJson(json::Writer& writer, const Enumeration<EnumType, ValueType>& enumeration);
+
+template<typename T>
+void toJson(json::Writer& writer, const Nullable<T>& nullable);
+
+template<typename... Args>
+void toJson(json::Writer& writer, const NullableVariant<Args...>& nullable);
+
+template<typename T>
+void toJson(json::Writer& writer, const std::unique_ptr<T>& v);
+
+template<typename T>
+void toJson(json::Writer& writer, const std::optional<T>& v);
+
 // fromJson
 
 template<typename T>
@@ -87,9 +122,9 @@ inline void fromJson(json::Any&& json, double& value){ value = static_cast<doubl
 inline void fromJson(json::Any&& json, std::string& value){ value = std::move(json.string()); }
 inline void fromJson(json::Any&& json, Uri& value){ value = Uri::parse(json.string()); }
 inline void fromJson(json::Any&& json, FileUri& value){ value = Uri::parse(json.string()); }
-inline void fromJson(json::Any&& json, json::Any& v){ v = std::move(json); }
-inline void fromJson(json::Any&& json, json::Object& v){ v = std::move(json.object()); }
-inline void fromJson(json::Any&& json, json::Array& v){ v = std::move(json.array()); }
+inline void fromJson(json::Any&& json, json::Any& v){ v = json::Any{std::allocator_arg, json::Allocator{}, std::move(json)}; }
+inline void fromJson(json::Any&& json, json::Object& v){ v = json::Object{std::move(json.object()), json::Allocator{}}; }
+inline void fromJson(json::Any&& json, json::Array& v){ v = json::Array{std::move(json.array()), json::Allocator{}}; }
 
 template<typename... Args>
 void fromJson(json::Any&& json, std::tuple<Args...>& value);
@@ -118,6 +153,52 @@ void fromJson(json::Any&& json, std::unique_ptr<T>& value);
 template<typename T>
 void fromJson(json::Any&& json, std::optional<T>& value);
 
+// fromJson (json::Reader)
+// The reader is expected to be positioned at the first token of the value and is left at its last token.
+
+inline void fromJson(json::Reader& reader, std::nullptr_t){ reader.skip(); }
+inline void fromJson(json::Reader& reader, bool& value){ value = reader.boolean(); }
+inline void fromJson(json::Reader& reader, int& value){ value = static_cast<int>(reader.number()); }
+inline void fromJson(json::Reader& reader, unsigned int& value){ value = static_cast<unsigned int>(reader.number()); }
+inline void fromJson(json::Reader& reader, long& value){ value = static_cast<long>(reader.number()); }
+inline void fromJson(json::Reader& reader, unsigned long& value){ value = static_cast<unsigned long>(reader.number()); }
+inline void fromJson(json::Reader& reader, unsigned long long& value){ value = static_cast<unsigned long long>(reader.number()); }
+inline void fromJson(json::Reader& reader, float& value){ value = static_cast<float>(reader.number()); }
+inline void fromJson(json::Reader& reader, double& value){ value = static_cast<double>(reader.number()); }
+inline void fromJson(json::Reader& reader, std::string& value){ value = std::move(reader.string()); }
+inline void fromJson(json::Reader& reader, Uri& value){ value = Uri::parse(reader.string()); }
+inline void fromJson(json::Reader& reader, FileUri& value){ value = Uri::parse(reader.string()); }
+inline void fromJson(json::Reader& reader, json::Any& v){ v = reader.readValue(); }
+inline void fromJson(json::Reader& reader, json::Object& v){ v = std::move(reader.readValue().object()); }
+inline void fromJson(json::Reader& reader, json::Array& v){ v = std::move(reader.readValue().array()); }
+
+template<typename... Args>
+void fromJson(json::Reader& reader, std::tuple<Args...>& value);
+
+template<typename K, typename T>
+void fromJson(json::Reader& reader, StrMap<K, T>& value);
+
+template<typename T>
+void fromJson(json::Reader& reader, std::vector<T>& value);
+
+template<typename... Args>
+void fromJson(json::Reader& reader, std::variant<Args...>& value);
+
+template<typename EnumType, typename ValueType>
+void fromJson(json::Reader& reader, Enumeration<EnumType, ValueType>& enumeration);
+
+template<typename T>
+void fromJson(json::Reader& reader, Nullable<T>& nullable);
+
+template<typename... Args>
+void fromJson(json::Reader& reader, NullableVariant<Args...>& nullable);
+
+template<typename T>
+void fromJson(json::Reader& reader, std::unique_ptr<T>& value);
+
+template<typename T>
+void fromJson(json::Reader& reader, std::optional<T>& value);
+
 namespace impl{
 
 // Helpers to treat FileURI as a string which can be used to look up values in a json::Object
@@ -185,8 +266,8 @@ std::size_t deserializableVariantIndex(const json::Any& json);
 template<std::size_t Index, typename TupleType>
 bool canDeserializeTupleElementsFromJson(const json::Any& json);
 
-template<std::size_t Index, typename TupleType>
-bool canDeserializeTupleFromJson(const json::Array& array);
+template<std::size_t Index, typename TupleType, typename ArrayType>
+bool canDeserializeTupleFromJson(const ArrayType& array);
 
 template<typename T>
 bool canDeserializeTypeFromJson(const json::Any& json)
@@ -209,6 +290,12 @@ bool canDeserializeTypeFromJson(const json::Any& json)
 	}
 	else if constexpr(IsVector<T>{})
 	{
+		if(json.isIntegerArray())
+		{
+			const auto& integers = json.integerArray();
+			return integers.empty() || canDeserializeTypeFromJson<typename T::value_type>(json::Any{integers[0]});
+		}
+
 		if(json.isArray())
 		{
 			const auto& array = json.array();
@@ -219,6 +306,9 @@ bool canDeserializeTypeFromJson(const json::Any& json)
 	}
 	else if constexpr(IsTuple<T>{})
 	{
+		if(json.isIntegerArray())
+			return canDeserializeTupleFromJson<0, T>(json.integerArray());
+
 		return json.isArray() && canDeserializeTupleFromJson<0, T>(json.array());
 	}
 	else if constexpr(IsEnumeration<T>{})
@@ -278,8 +368,9 @@ bool canDeserializeTypeFromJson(const json::Any& json)
 	}
 }
 
-template<std::size_t Index, typename TupleType>
-bool canDeserializeTupleFromJson(const json::Array& array)
+// Takes either a json::Array or a json::IntegerArray so packed integers don't have to be unpacked
+template<std::size_t Index, typename TupleType, typename ArrayType>
+bool canDeserializeTupleFromJson(const ArrayType& array)
 {
 	if constexpr(Index == 0) // Only perform this check one time for the first element
 	{
@@ -331,6 +422,84 @@ void variantFromJson(json::Any&& json, VariantType& variant, const std::size_t i
 	}
 }
 
+inline void expectToken(const json::Reader& reader, json::Reader::Token token)
+{
+	if(reader.token() != token)
+		throw json::TypeError{};
+}
+
+/*
+ * Reads the properties of a json object one by one.
+ * Generated structure deserializers use this to read their properties directly from the json text.
+ * Properties are identified by their index with the required ones coming first.
+ * Duplicate keys are rejected like json::parse does.
+ */
+class ObjectReader{
+public:
+	// Up to 64 properties are supported
+	explicit ObjectReader(json::Reader& reader, std::span<const char* const> requiredProperties = {})
+		: m_reader{reader}
+	  , m_requiredProperties{requiredProperties}
+	{
+		assert(requiredProperties.size() <= 64);
+		expectToken(reader, json::Reader::Token::StartObject);
+	}
+
+	bool nextKey()
+	{
+		return m_reader.next() == json::Reader::Token::Key;
+	}
+
+	std::string_view key() const
+	{
+		return m_reader.string();
+	}
+
+	template<typename T>
+	void read(std::size_t index, T& value)
+	{
+		assert(index < 64);
+		const auto bit = std::uint64_t{1} << index;
+
+		if(m_readProperties & bit)
+			throwDuplicateKey();
+
+		m_readProperties |= bit;
+		m_reader.next();
+		fromJson(m_reader, value);
+	}
+
+	void skip()
+	{
+		// Unknown keys are rare so they are simply compared with each other
+		if(std::find(m_skippedKeys.begin(), m_skippedKeys.end(), key()) != m_skippedKeys.end())
+			throwDuplicateKey();
+
+		m_skippedKeys.emplace_back(key());
+		m_reader.skip();
+	}
+
+	void verifyRequired() const
+	{
+		for(std::size_t i = 0; i < m_requiredProperties.size(); ++i)
+		{
+			if(!(m_readProperties & (std::uint64_t{1} << i)))
+				throw json::TypeError{"Missing key '" + std::string{m_requiredProperties[i]} + '\''};
+		}
+	}
+
+private:
+	json::Reader&                m_reader;
+	std::span<const char* const> m_requiredProperties;
+	std::uint64_t                m_readProperties = 0;
+	std::vector<std::string>     m_skippedKeys;
+
+	[[noreturn]] void throwDuplicateKey() const
+	{
+		throw json::ParseError{"Duplicate key '" + std::string{key()} + '\'', m_reader.position()};
+	}
+};
+
 } // namespace impl
 
 // toJson
@@ -400,6 +569,17 @@ json::Any toJson(StrMap<K, T>&& map)
 template<typename T>
 json::Any toJson(std::vector<T>&& vector)
 {
+	if constexpr(std::is_integral_v<T> && !std::is_same_v<T, bool>)
+	{
+		if(std::all_of(vector.begin(), vector.end(), [](T e){ return std::in_range<json::Integer>(e); }))
+		{
+			json::IntegerArray result;
+			result.reserve(vector.size());
+			std::transform(vector.begin(), vector.end(), std::back_inserter(result), [](T e){ return static_cast<json::Integer>(e); });
+			return result;
+		}
+	}
+
 	json::Array result;
 	result.reserve(vector.size());
 	std::transform(vector.begin(), vector.end(), std::back_inserter(result), [](auto&& e){ return toJson(std::forward<T>(e)); });
@@ -450,6 +630,131 @@ json::Any toJson(std::optional<T>&& v)
 	return toJson(std::move(*v));
 }
 
+// toJson (json::Writer)
+
+inline void toJson(json::Writer& writer, std::nullptr_t){ writer.null(); }
+inline void toJson(json::Writer& writer, bool v){ writer.boolean(v); }
+inline void toJson(json::Writer& writer, int i){ writer.integer(i); }
+inline void toJson(json::Writer& writer, unsigned int i){ writer.value(toJson(i)); }
+inline void toJson(json::Writer& writer, long i){ writer.value(toJson(i)); }
+inline void toJson(json::Writer& writer, unsigned long i){ writer.value(toJson(i)); }
+inline void toJson(json::Writer& writer, long long i){ writer.value(toJson(i)); }
+inline void toJson(json::Writer& writer, unsigned long long i){ writer.value(toJson(i)); }
+inline void toJson(json::Writer& writer, float i){ writer.decimal(i); }
+inline void toJson(json::Writer& writer, double i){ writer.decimal(i); }
+inline void toJson(json::Writer& writer, const std::string& v){ writer.string(v); }
+inline void toJson(json::Writer& writer, std::string_view v){ writer.string(v); }
+inline void toJson(json::Writer& writer, const Uri& uri){ writer.string(uri.toString()); }
+inline void toJson(json::Writer& writer, const FileUri& uri){ writer.string(uri.toString()); }
+inline void toJson(json::Writer& writer, const json::Any& v){ writer.value(v); }
+
+inline void toJson(json::Writer& writer, const json::Object& v)
+{
+	writer.startObject();
+
+	for(const auto& [key, value] : v)
+	{
+		writer.key(key);
+		writer.value(value);
+	}
+
+	writer.endObject();
+}
+
+inline void toJson(json::Writer& writer, const json::Array& v)
+{
+	writer.startArray();
+
+	for(const auto& value : v)
+		writer.value(value);
+
+	writer.endArray();
+}
+
+template<typename... Args>
+void toJson(json::Writer& writer, const std::tuple<Args...>& tuple)
+{
+	writer.startArray();
+	std::apply([&writer](const auto&... tupleArgs){ (toJson(writer, tupleArgs), ...); }, tuple);
+	writer.endArray();
+}
+
+template<typename K, typename T>
+void toJson(json::Writer& writer, const StrMap<K, T>& map)
+{
+	writer.startObject();
+
+	for(const auto& [k, v] : map)
+	{
+		writer.key(impl::mapKey(k));
+		toJson(writer, v);
+	}
+
+	writer.endObject();
+}
+
+template<typename T>
+void toJson(json::Writer& writer, const std::vector<T>& vector)
+{
+	if constexpr(std::is_same_v<T, json::Integer> || std::is_same_v<T, std::uint32_t>)
+	{
+		writer.integerArray(vector);
+	}
+	else
+	{
+		writer.startArray();
+
+		for(const auto& e : vector)
+			toJson(writer, e);
+
+		writer.endArray();
+	}
+}
+
+template<typename... Args>
+void toJson(json::Writer& writer, const std::variant<Args...>& variant)
+{
+	std::visit([&writer](const auto& v){ toJson(writer, v); }, variant);
+}
+
+template<typename EnumType, typename ValueType>
+void toJson(json::Writer& writer, const Enumeration<EnumType, ValueType>& enumeration)
+{
+	toJson(writer, enumeration.value());
+}
+
+template<typename T>
+void toJson(json::Writer& writer, const Nullable<T>& nullable)
+{
+	if(nullable.isNull())
+		writer.null();
+	else
+		toJson(writer, *nullable);
+}
+
+template<typename... Args>
+void toJson(json::Writer& writer, const NullableVariant<Args...>& nullable)
+{
+	if(nullable.isNull())
+		writer.null();
+	else
+		toJson(writer, *nullable);
+}
+
+template<typename T>
+void toJson(json::Writer& writer, const std::unique_ptr<T>& v)
+{
+	assert(v);
+	toJson(writer, *v);
+}
+
+template<typename T>
+void toJson(json::Writer& writer, const std::optional<T>& v)
+{
+	assert(v.has_value());
+	toJson(writer, *v);
+}
+
 // fromJson
 
 template<typename... Args>
@@ -509,6 +814,17 @@ void fromJson(json::Any&& json, StrMap<FileUri, T>& value)
 template<typename T>
 void fromJson(json::Any&& json, std::vector<T>& value)
 {
+	if constexpr(std::is_arithmetic_v<T> && !std::is_same_v<T, bool>)
+	{
+		if(json.isIntegerArray())
+		{
+			const auto& integers = std::as_const(json).integerArray();
+			value.reserve(integers.size());
+			std::transform(integers.begin(), integers.end(), std::back_inserter(value), [](json::Integer e){ return static_cast<T>(e); });
+			return;
+		}
+	}
+
 	auto& array = json.array();
 	value.reserve(array.size());
 
@@ -581,4 +897,158 @@ void fromJson(json::Any&& json, std::optional<T>& value)
 	fromJson(std::move(json), *value);
 }
 
+// fromJson (json::Reader)
+
+template<typename... Args>
+void fromJson(json::Reader& reader, std::tuple<Args...>& value)
+{
+	impl::expectToken(reader, json::Reader::Token::StartArray);
+
+	std::apply(
+		[&reader](auto&&... tupleArgs)
+		{
+			const auto readElement = [&reader](auto& element)
+			{
+				if(reader.next() == json::Reader::Token::EndArray)
+					throw json::TypeError("Incorrect number of tuple elements");
+
+				fromJson(reader, element);
+			};
+
+			(readElement(tupleArgs), ...);
+		}, value);
+
+	if(reader.next() != json::Reader::Token::EndArray)
+		throw json::TypeError("Incorrect number of tuple elements");
+}
+
+template<typename K, typename T>
+void fromJson(json::Reader& reader, StrMap<K, T>& value)
+{
+	impl::expectToken(reader, json::Reader::Token::StartObject);
+
+	while(reader.next() == json::Reader::Token::Key)
+	{
+		auto& element = value[reader.string()];
+		reader.next();
+		fromJson(reader, element);
+	}
+}
+
+template<typename T>
+void fromJson(json::Reader& reader, StrMap<Uri, T>& value)
+{
+	impl::expectToken(reader, json::Reader::Token::StartObject);
+
+	while(reader.next() == json::Reader::Token::Key)
+	{
+		auto uri = Uri::parse(reader.string());
+
+		if(uri.isValid())
+		{
+			reader.next();
+			fromJson(reader, value[std::move(uri)]);
+		}
+		else
+		{
+			reader.skip();
+		}
+	}
+}
+
+template<typename T>
+void fromJson(json::Reader& reader, StrMap<FileUri, T>& value)
+{
+	impl::expectToken(reader, json::Reader::Token::StartObject);
+
+	while(reader.next() == json::Reader::Token::Key)
+	{
+		auto fileUri = FileUri(Uri::parse(reader.string()));
+
+		if(fileUri.isValid())
+		{
+			reader.next();
+			fromJson(reader, value[std::move(fileUri)]);
+		}
+		else
+		{
+			reader.skip();
+		}
+	}
+}
+
+template<typename T>
+void fromJson(json::Reader& reader, std::vector<T>& value)
+{
+	impl::expectToken(reader, json::Reader::Token::StartArray);
+
+	while(reader.next() != json::Reader::Token::EndArray)
+		fromJson(reader, value.emplace_back());
+}
+
+template<typename... Args>
+void fromJson(json::Reader& reader, std::variant<Args...>& value)
+{
+	// The matching alternative can only be determined by looking at the entire value
+	fromJson(reader.readValue(), value);
+}
+
+template<typename EnumType, typename ValueType>
+void fromJson(json::Reader& reader, Enumeration<EnumType, ValueType>& enumeration)
+{
+	ValueType value{};
+	fromJson(reader, value);
+	enumeration = std::move(value);
+}
+
+template<typename T>
+void fromJson(json::Reader& reader, Nullable<T>& nullable)
+{
+	if(reader.token() == json::Reader::Token::Null)
+	{
+		nullable.reset();
+	}
+	else
+	{
+		if(nullable.isNull())
+			nullable = T{};
+
+		fromJson(reader, *nullable);
+	}
+}
+
+template<typename... Args>
+void fromJson(json::Reader& reader, NullableVariant<Args...>& nullable)
+{
+	if(reader.token() == json::Reader::Token::Null)
+	{
+		nullable.reset();
+	}
+	else
+	{
+		if(nullable.isNull())
+			nullable = typename NullableVariant<Args...>::VariantType{};
+
+		fromJson(reader, *nullable);
+	}
+}
+
+template<typename T>
+void fromJson(json::Reader& reader, std::unique_ptr<T>& value)
+{
+	if(!value)
+		value = std::make_unique<T>();
+
+	fromJson(reader, *value);
+}
+
+template<typename T>
+void fromJson(json::Reader& reader, std::optional<T>& value)
+{
+	if(!value.has_value())
+		value = T{};
+
+	fromJson(reader, *value);
+}
+
 } // namespace lsp
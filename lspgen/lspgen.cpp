@@ -1,4 +1,5 @@
 #include <map>
+#include <set>
 #include <memory>
 #include <cassert>
 #include <cstdlib>
@@ -7,6 +8,7 @@
 #include <algorithm>
 #include <unordered_map>
 #include <unordered_set>
+#include <variant>
 #include <lsp/json/json.h>
 
 /*
@@ -1003,7 +1005,7 @@ public:
 	void writeFiles()
 	{
 		writeFile("types.h", replaceString(TypesHeaderBegin, "${LSP_VERSION}", m_metaModel.metaData().version) + m_typesHeaderFileContent + m_typesBoilerPlateHeaderFileContent + TypesHeaderEnd);
-		writeFile("types.cpp", TypesSourceBegin + m_typesSourceFileContent + m_typesBoilerPlateSourceFileContent + TypesSourceEnd);
+		writeFile("types.cpp", TypesSourceBegin + propertyKeysSource() + m_typesSourceFileContent + m_typesBoilerPlateSourceFileContent + TypesSourceEnd);
 		writeFile("messages.h", MessagesHeaderBegin + m_messagesHeaderFileContent + MessagesHeaderEnd);
 	}
 
@@ -1017,6 +1019,7 @@ private:
 	std::unordered_set<std::string_view>         m_processedTypes;
 	std::unordered_set<std::string_view>         m_typesBeingProcessed;
 	std::unordered_map<const Type*, std::string> m_generatedTypeNames;
+	std::set<std::string>                        m_propertyKeys;
 
 	struct CppBaseType
 	{
@@ -1155,6 +1158,16 @@ private:
 		return "void fromJson(json::Any&& json, " + typeName + "& value)";
 	}
 
+	static std::string writerToJsonSig(const std::string& typeName)
+	{
+		return "void toJson(json::Writer& writer, const " + typeName + "& value)";
+	}
+
+	static std::string readerFromJsonSig(const std::string& typeName)
+	{
+		return "void fromJson(json::Reader& reader, " + typeName + "& value)";
+	}
+
 	static std::string documentationComment(const std::string& title, const std::string& documentation, std::size_t indentLevel = 0)
 	{
 		std::string indent(indentLevel, '\t');
@@ -1495,6 +1508,202 @@ private:
 		return false;
 	}
 
+	static std::string literalValueString(const Type& type)
+	{
+		switch(type.category())
+		{
+		case Type::StringLiteral:
+			return json::toStringLiteral(type.as<StringLiteralType>().stringValue);
+		case Type::IntegerLiteral:
+			return std::to_string(type.as<IntegerLiteralType>().integerValue);
+		case Type::BooleanLiteral:
+			return type.as<BooleanLiteralType>().booleanValue ? "true" : "false";
+		default:
+			return {};
+		}
+	}
+
+	struct SerializedProperty{
+		std::string_view name;
+		bool             isOptional = false;
+		std::string      literalValue;
+	};
+
+	// Collects all properties of a structure including the ones from base classes and mixins in the order they are serialized
+	void collectSerializedProperties(const Structure& structure, std::vector<SerializedProperty>& serializedProperties) const
+	{
+		std::unordered_map<std::string_view, const StructureProperty*> basePropertiesByName;
+
+		for(const auto& e : structure.extends)
+		{
+			const auto& base = *std::get<const Structure*>(m_metaModel.typeForName(e->as<ReferenceType>().name));
+
+			if(e == structure.extends.front())
+			{
+				for(const auto& p : base.properties)
+					basePropertiesByName[p.name] = &p;
+			}
+
+			collectSerializedProperties(base, serializedProperties);
+		}
+
+		const auto addProperties = [&](const std::vector<StructureProperty>& properties)
+		{
+			for(const auto& p : properties)
+			{
+				auto it = std::find_if(serializedProperties.begin(), serializedProperties.end(), [&p](const SerializedProperty& rp){ return rp.name == p.name; });
+
+				if(it == serializedProperties.end())
+				{
+					serializedProperties.push_back({p.name, p.isOptional, literalValueString(*p.type)});
+				}
+				else if(p.type->isLiteral() && basePropertiesByName.contains(p.name))
+				{
+					// Literal properties with the same name as an inherited property only restrict the value of the inherited one
+					it->literalValue = literalValueString(*p.type);
+				}
+				else
+				{
+					throw std::runtime_error{"Property '" + p.name + "' of '" + structure.name + "' is declared more than once"};
+				}
+			}
+		};
+
+		for(const auto& m : structure.mixins)
+			addProperties(std::get<const Structure*>(m_metaModel.typeForName(m->as<ReferenceType>().name))->properties);
+
+		addProperties(structure.properties);
+	}
+
+	std::string readerFromJson(const Structure& structure, const std::string& structureCppName) const
+	{
+		std::vector<SerializedProperty> properties;
+		collectSerializedProperties(structure, properties);
+
+		std::string result = readerFromJsonSig(structureCppName) + "\n{\n";
+		std::string requiredList;
+		std::size_t requiredCount = 0;
+		std::string readProperties;
+
+		// Required properties get the first indices so ObjectReader can tell if they were read
+		for(const auto& p : properties)
+		{
+			if(!p.isOptional)
+				requiredList += (requiredCount++ > 0 ? ", \"" : "\"") + std::string{p.name} + '"';
+		}
+
+		std::size_t requiredIndex = 0;
+		std::size_t optionalIndex = requiredCount;
+
+		for(const auto& p : properties)
+		{
+			const auto index = p.isOptional ? optionalIndex++ : requiredIndex++;
+			const auto read  = "object.read(" + std::to_string(index) + ", value." + std::string{p.name} + ");";
+
+			readProperties += readProperties.empty() ? "\t\tif" : "\t\telse if";
+			readProperties += "(key == \"" + std::string{p.name} + "\")\n";
+
+			if(p.literalValue.empty())
+			{
+				readProperties += "\t\t\t" + read + '\n';
+			}
+			else
+			{
+				readProperties += "\t\t{\n"
+				                  "\t\t\t" + read + "\n\n"
+				                  "\t\t\tif(value." + std::string{p.name} + " != " + p.literalValue + ")\n"
+				                  "\t\t\t\tthrow json::TypeError(\"Unexpected value for literal '" + std::string{p.name} + "'\");\n"
+				                  "\t\t}\n";
+			}
+		}
+
+		if(properties.size() > 64)
+			throw std::runtime_error{"Structure '" + structure.name + "' has more properties than supported by impl::ObjectReader"};
+
+		if(requiredCount > 0)
+		{
+			result += "\tstatic const char* const requiredProperties[] = {" + requiredList + "};\n"
+			          "\timpl::ObjectReader object{reader, requiredProperties};\n\n";
+		}
+		else
+		{
+			result += "\timpl::ObjectReader object{reader};\n\n";
+		}
+
+		if(properties.empty())
+		{
+			result += "\twhile(object.nextKey())\n"
+			          "\t\tobject.skip();\n";
+		}
+		else
+		{
+			result += "\twhile(object.nextKey())\n"
+			          "\t{\n"
+			          "\t\tconst auto key = object.key();\n\n" +
+			          readProperties +
+			          "\t\telse\n"
+			          "\t\t\tobject.skip();\n"
+			          "\t}\n";
+		}
+
+		if(requiredCount > 0)
+			result += "\n\tobject.verifyRequired();\n";
+
+		return result + "}\n\n";
+	}
+
+	std::string writerToJson(const Structure& structure, const std::string& structureCppName) const
+	{
+		std::vector<SerializedProperty> properties;
+		collectSerializedProperties(structure, properties);
+
+		std::string result = writerToJsonSig(structureCppName) + "\n{\n"
+		                     "\twriter.startObject();\n";
+
+		for(const auto& p : properties)
+		{
+			const std::string name{p.name};
+
+			if(p.isOptional)
+			{
+				result += "\tif(value." + name + ")\n"
+				          "\t{\n"
+				          "\t\twriter.key(\"" + name + "\");\n"
+				          "\t\ttoJson(writer, value." + name + ");\n"
+				          "\t}\n";
+			}
+			else
+			{
+				result += "\twriter.key(\"" + name + "\");\n"
+				          "\ttoJson(writer, value." + name + ");\n";
+			}
+		}
+
+		return result + "\twriter.endObject();\n"
+		                "}\n\n";
+	}
+
+	/*
+	 * Properties are looked up with interned json keys defined once at the top of types.cpp
+	 */
+	std::string propertyKey(const std::string& name)
+	{
+		m_propertyKeys.insert(name);
+		return "keys::" + name;
+	}
+
+	std::string propertyKeysSource() const
+	{
+		std::string source = "/*\n * Object keys\n */\n\nnamespace keys{\n\n";
+
+		for(const auto& name : m_propertyKeys)
+			source += "static const json::Key " + name + " = json::Key::intern(\"" + name + "\");\n";
+
+		source += "\n} // namespace keys\n\n";
+
+		return source;
+	}
+
 	void generateStructureProperties(const std::vector<StructureProperty>& properties,
 	                                 const std::unordered_map<std::string_view,
 	                                 const StructureProperty*>& basePropertiesByName,
@@ -1506,26 +1715,11 @@ private:
 	{
 		for(const auto& p : properties)
 		{
-			std::string literalValue;
+			const std::string literalValue = literalValueString(*p.type);
 			bool isInheritedLiteral = false;
 
 			if(p.type->isLiteral())
 			{
-				switch(p.type->category())
-				{
-				case Type::StringLiteral:
-					literalValue = json::toStringLiteral(p.type->as<StringLiteralType>().stringValue);
-					break;
-				case Type::IntegerLiteral:
-					literalValue = std::to_string(p.type->as<IntegerLiteralType>().integerValue);
-					break;
-				case Type::BooleanLiteral:
-					literalValue = std::string{p.type->as<BooleanLiteralType>().booleanValue ? "true" : "false"};
-					break;
-				default:
-					break;
-				}
-
 				if(basePropertiesByName.contains(p.name))
 				{
 					inheritedLiterals.emplace_back(p.name, literalValue);
@@ -1552,13 +1746,13 @@ private:
 			if(p.isOptional)
 			{
 				toJson += "\tif(value." + p.name + ")\n\t";
-				fromJson += "\tif(const auto it = json.find(\"" + p.name + "\"); it != json.end())\n\t"
+				fromJson += "\tif(const auto it = json.find(" + propertyKey(p.name) + "); it != json.end())\n\t"
 				            "\tfromJson(std::move(it->second), value." + p.name + ");\n";
 			}
 			else
 			{
 				if(!isInheritedLiteral)
-					fromJson += "\tfromJson(std::move(json.get(\"" + p.name + "\")), value." + p.name + ");\n";
+					fromJson += "\tfromJson(std::move(json.get(" + propertyKey(p.name) + ")), value." + p.name + ");\n";
 
 				if(literalValue.empty())
 					requiredProperties.push_back(p.name);
@@ -1580,7 +1774,7 @@ private:
 				else
 					toJsonParam = "std::move(value." + p.name + ')';
 
-				toJson += "\tjson[\"" + p.name + "\"] = toJson(" + toJsonParam + ");\n";
+				toJson += "\tjson[" + propertyKey(p.name) + "] = toJson(" + toJsonParam + ");\n";
 			}
 		}
 	}
@@ -1719,7 +1913,9 @@ private:
 		}
 
 		m_typesBoilerPlateHeaderFileContent += toJson + ";\n" +
-		                                       fromJson + ";\n";
+		                                       writerToJsonSig(structureCppName) + ";\n" +
+		                                       fromJson + ";\n" +
+		                                       readerFromJsonSig(structureCppName) + ";\n";
 		m_typesSourceFileContent += propertiesToJson + propertiesFromJson;
 		m_typesBoilerPlateSourceFileContent += toJson + "\n"
 		                                       "{\n"
@@ -1727,11 +1923,13 @@ private:
 		                                       "\t" + uncapitalizeString(structureCppName) + "ToJson(value, obj);\n"
 		                                       "\treturn obj;\n"
 		                                       "}\n\n" +
+		                                       writerToJson(structure, structureCppName) +
 		                                       fromJson + "\n"
 		                                       "{\n"
 		                                       "\tauto& obj = json.object();\n"
 		                                       "\t" + uncapitalizeString(structureCppName) + "FromJson(obj, value);\n"
-		                                       "}\n\n";
+		                                       "}\n\n" +
+		                                       readerFromJson(structure, structureCppName);
 	}
 
 	void generate(const TypeAlias& typeAlias)